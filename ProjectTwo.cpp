@@ -7,17 +7,78 @@
 //============================================================================
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <time.h>
-#include <Windows.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
 #include <vector>
 #include <list>
 #include <sstream>
 #include <fstream>
 #include <iomanip>
 
+#ifdef _WIN32
+// keep <Windows.h> from defining min and max macros over std::min / std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the Windows build check: a min or max macro from a <Windows.h> included
+// earlier without NOMINMAX (a precompiled header, say) would break every
+// std::min / std::max below with unrelated errors, so stop here instead
+#if defined(min) || defined(max)
+#error "min/max macros are defined: include <Windows.h> with NOMINMAX before this file"
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CSV_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CSV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CSV_TARGET(isa)
+#endif
+
 using namespace std;
 
 class Error : public std::runtime_error
@@ -30,52 +91,491 @@ public:
     }
 };
 
+/*
+** METRICS
+**
+** Counters and timing histograms for the hot paths. Build with
+** -DCSV_METRICS=0 to compile them out; compiled in, every event costs
+** one relaxed load until Metrics::enable(true), e.g. through --stats.
+**
+** ALLOCATIONS and ALLOCATED_BYTES need the global operator new replaced,
+** which affects the whole program, so they are opt-in on top of that:
+** build with -DCSV_COUNT_ALLOCATIONS=1, otherwise they stay at 0.
+*/
+
+#ifndef CSV_METRICS
+#define CSV_METRICS 1
+#endif
+#ifndef CSV_COUNT_ALLOCATIONS
+#define CSV_COUNT_ALLOCATIONS 0
+#endif
+
+class Metrics
+{
+public:
+    enum Counter
+    {
+        BYTES_READ,
+        ROWS_PARSED,
+        ALLOCATIONS,
+        ALLOCATED_BYTES,
+        SORT_COMPARISONS,
+        SORT_SWAPS,
+        SEARCH_LOOKUPS,
+        SEARCH_PROBES,
+        COUNTER_COUNT
+    };
+    enum Timer
+    {
+        PARSER_CONSTRUCT,
+        FILE_READ,
+        PARSE_CONTENT,
+        FOR_EACH_ROW, // includes the callback
+        LOAD_COURSES,
+        QUICK_SORT,
+        SELECTION_SORT,
+        KEY_SORT,
+        SEARCH,
+        FUZZY_SEARCH,
+        KEYWORD_SEARCH,
+        TIMER_COUNT
+    };
+    static const int BUCKETS = 48; // bucket i counts durations in [2^i, 2^(i+1)) ns
+
+public:
+    static bool enabled(void)
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+    static void enable(bool);
+    static void add(Counter, std::uint64_t count = 1);
+    static void record(Timer, std::uint64_t nanoseconds);
+    static void reset(void);
+    static void dump(std::ostream&);
+    static std::string json(void);
+
+private:
+    struct Histogram
+    {
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> total; // ns
+        std::atomic<std::uint64_t> max;
+        std::atomic<std::uint64_t> buckets[BUCKETS];
+    };
+    static double percentile(const Histogram&, double);
+    static double parseMsPerMb(void);
+
+    static std::atomic<bool> _enabled;
+    static std::atomic<std::uint64_t> _counters[COUNTER_COUNT];
+    static Histogram _timers[TIMER_COUNT];
+    static const char* const _counterNames[COUNTER_COUNT];
+    static const char* const _timerNames[TIMER_COUNT];
+};
+
+// times its own lifetime into one of the Metrics timers
+class MetricScope
+{
+public:
+    MetricScope(Metrics::Timer);
+    ~MetricScope(void);
+    MetricScope(const MetricScope&) = delete;
+    MetricScope& operator=(const MetricScope&) = delete;
+
+private:
+    Metrics::Timer _timer;
+    bool _active;
+    std::chrono::steady_clock::time_point _start;
+};
+
+#if CSV_METRICS
+#define CSV_COUNT(counter, n) do { if (Metrics::enabled()) Metrics::add(Metrics::counter, (n)); } while (0)
+#define CSV_SCOPE(timer) MetricScope csvMetricScope(Metrics::timer)
+#else
+#define CSV_COUNT(counter, n) do { } while (0)
+#define CSV_SCOPE(timer) do { } while (0)
+#endif
+
+/*
+** WORKER POOL
+**
+** Fixed set of threads draining a shared task queue. Tasks may submit
+** more tasks; wait() returns once all of them have finished and
+** rethrows the first exception a task raised.
+*/
+
+class WorkerPool
+{
+public:
+    WorkerPool(unsigned int threads = 0);
+    ~WorkerPool(void);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+public:
+    unsigned int size(void) const;
+    void submit(std::function<void(void)>);
+    void wait(void);
+
+private:
+    void work(void);
+    void run(std::unique_lock<std::mutex>&);
+
+private:
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void(void)> > _tasks;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _done;
+    std::size_t _pending; // queued or running
+    std::exception_ptr _error;
+    bool _stop;
+};
+
+/*
+** MAPPED FILE
+**
+** Read-only view of a whole file, backed by the OS page cache.
+*/
+
+class MappedFile
+{
+public:
+    MappedFile(const std::string&);
+    ~MappedFile(void);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    const char* data(void) const;
+    std::size_t size(void) const;
+
+private:
+    const char* _data;
+    std::size_t _size;
+#ifdef _WIN32
+    HANDLE _handle;
+    HANDLE _mapping;
+#else
+    int _fd;
+#endif
+};
+
+/*
+** STRUCTURAL SCANNER
+**
+** Finds the separators and newlines that sit outside quotes, 64 bytes at
+** a time. Each block is classified into quote / separator / newline bit
+** masks by an SSE2 or AVX2 kernel picked at runtime (scalar elsewhere);
+** a prefix XOR over the quote bits then masks out everything quoted.
+*/
+
+class StructuralScanner
+{
+public:
+    StructuralScanner(const char* begin, const char* end, char sep);
+
+public:
+    const char* next(void);
+    std::size_t newlinesBefore(const char* it) const;
+
+private:
+    void load(void);
+
+private:
+    const char* _begin;
+    const char* _end;
+    std::size_t _offset;      // start of the current block
+    char _sep;
+    std::uint64_t _structural; // separators and newlines not visited yet
+    std::uint64_t _newlines;   // every newline of the current block
+    std::uint64_t _quoted;     // all ones if the block starts inside quotes
+    std::size_t _linesBefore; // newlines before the current block
+    bool _done;
+};
+
+/*
+** COLUMN
+**
+** All values of one column packed in a single byte buffer and addressed
+** through an (offset, length) cell per row. A column built over a mapped
+** file borrows the mapping and only copies its bytes once it is modified.
+*/
+
+class Column
+{
+public:
+    Column(const char* external = nullptr);
+
+public:
+    std::size_t size(void) const;
+    void reserve(std::size_t);
+    void push(std::string_view);
+    void pushView(std::string_view);
+    void append(const Column&);
+    void insert(std::size_t, std::string_view);
+    void assign(std::size_t, std::string_view);
+    void erase(std::size_t);
+
+private:
+    struct Cell
+    {
+        std::uint64_t offset;
+        std::uint32_t length;
+    };
+
+    const char* base(void) const;
+    Cell store(std::string_view);
+    void repack(void);
+
+private:
+    const char* _external;
+    std::string _bytes;
+    std::vector<Cell> _cells;
+    std::size_t _garbage;
+
+public:
+    std::string_view operator[](std::size_t pos) const
+    {
+        return std::string_view(base() + _cells[pos].offset, _cells[pos].length);
+    }
+    friend class ColumnView;
+};
+
+/*
+** Cheap iterable over a Column. Invalidated by any change to the column.
+*/
+class ColumnView
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = std::string_view;
+
+        iterator(const char* base, const Column::Cell* cell) : _base(base), _cell(cell) {}
+        std::string_view operator*(void) const { return std::string_view(_base + _cell->offset, _cell->length); }
+        iterator& operator++(void) { ++_cell; return *this; }
+        iterator operator++(int) { iterator tmp(*this); ++_cell; return tmp; }
+        bool operator==(const iterator& other) const { return _cell == other._cell; }
+        bool operator!=(const iterator& other) const { return _cell != other._cell; }
+
+    private:
+        const char* _base;
+        const Column::Cell* _cell;
+    };
+
+public:
+    ColumnView(const Column& column)
+        : _base(column.base()), _cells(column._cells.data()), _size(column._cells.size()) {}
+
+    iterator begin(void) const { return iterator(_base, _cells); }
+    iterator end(void) const { return iterator(_base, _cells + _size); }
+    std::size_t size(void) const { return _size; }
+    std::string_view operator[](std::size_t pos) const
+    {
+        return std::string_view(_base + _cells[pos].offset, _cells[pos].length);
+    }
+
+private:
+    const char* _base;
+    const Column::Cell* _cells;
+    std::size_t _size;
+};
+
+/*
+** FIELD CONVERSION
+**
+** Text to typed value without allocation or locale: numbers go through
+** std::from_chars, blanks and surrounding quotes are ignored. Other types
+** fall back to a stringstream.
+*/
+
+template<typename T>
+bool convertField(std::string_view text, T& out)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r'))
+        text.remove_suffix(1);
+    if (text.size() >= 2 && text.front() == '"' && text.back() == '"')
+        text = text.substr(1, text.size() - 2);
+
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        unsigned int value;
+        if (!convertField(text, value))
+            return false;
+        out = value != 0;
+        return true;
+    }
+    else if constexpr (std::is_arithmetic<T>::value)
+    {
+        if (!text.empty() && text.front() == '+')
+            text.remove_prefix(1);
+        const char* end = text.data() + text.size();
+        std::from_chars_result result = std::from_chars(text.data(), end, out);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+    else if constexpr (std::is_assignable<T&, std::string_view>::value)
+    {
+        out = text;
+        return true;
+    }
+    else
+    {
+        std::stringstream ss;
+        ss << text;
+        ss >> out;
+        return !ss.fail();
+    }
+}
+
+/*
+** SCHEMA
+**
+** Column names shared by a parser and all of its rows. Immutable once
+** built; name lookups go through a precomputed hash map.
+*/
+
+class Schema
+{
+public:
+    // a column name resolved once, so per-row access is an array index
+    struct Handle
+    {
+        unsigned int index;
+    };
+
+public:
+    Schema(const std::vector<std::string>&);
+
+public:
+    unsigned int size(void) const;
+    const std::vector<std::string>& names(void) const;
+    const std::string& name(unsigned int pos) const;
+    bool find(const std::string&, unsigned int& pos) const;
+    Handle resolve(const std::string&) const;
+
+private:
+    std::vector<std::string> _names;
+    std::unordered_map<std::string, unsigned int> _index;
+};
+
+class Parser;
+
+/*
+** One record handed to a Parser::forEachRow callback. The values point
+** into the read buffer and are only valid during the callback.
+*/
+class RecordView
+{
+public:
+    RecordView(const Schema& schema) : _schema(schema), _values(nullptr), _line(0) {}
+
+    const Schema& schema(void) const { return _schema; }
+    unsigned int size(void) const { return _values->size(); }
+    std::size_t line(void) const { return _line; }
+    const std::vector<std::string_view>& values(void) const { return *_values; }
+    std::string_view operator[](unsigned int pos) const
+    {
+        if (pos < _values->size())
+            return (*_values)[pos];
+        throw Error("can't return this value (doesn't exist)");
+    }
+    std::string_view operator[](Schema::Handle handle) const { return (*this)[handle.index]; }
+
+private:
+    const Schema& _schema;
+    const std::vector<std::string_view>* _values;
+    std::size_t _line;
+    friend class Parser;
+};
+
 class Row
 {
 public:
     Row(const std::vector<std::string>&);
+    Row(const std::shared_ptr<const Schema>&);
     ~Row(void);
 
 public:
     unsigned int size(void) const;
     void push(const std::string&);
     bool set(const std::string&, const std::string&);
+    void set(Schema::Handle, const std::string&);
+    const Schema& schema(void) const;
+
+private:
+    // rows handed out by a Parser read and write its columns directly
+    Row(const std::shared_ptr<const Schema>&, Parser*, unsigned int);
+    std::string_view view(unsigned int) const;
 
 private:
-    const std::vector<std::string> _header;
+    std::shared_ptr<const Schema> _schema;
     std::vector<std::string> _values;
+    Parser* _owner;
+    unsigned int _index;
 
 public:
 
     template<typename T>
     const T getValue(unsigned int pos) const
     {
-        if (pos < _values.size())
+        if (pos < size())
         {
             T res;
-            std::stringstream ss;
-            ss << _values[pos];
-            ss >> res;
+            if (!convertField(view(pos), res))
+                throw Error("can't convert this value");
             return res;
         }
         throw Error("can't return this value (doesn't exist)");
     }
+    // false if the value is missing or does not convert
+    template<typename T>
+    bool tryGetValue(unsigned int pos, T& out) const
+    {
+        return pos < size() && convertField(view(pos), out);
+    }
+    template<typename T>
+    const T getValue(Schema::Handle handle) const
+    {
+        return getValue<T>(handle.index);
+    }
     const std::string operator[](unsigned int) const;
     const std::string operator[](const std::string& valueName) const;
+    const std::string operator[](Schema::Handle) const;
     friend std::ostream& operator<<(std::ostream& os, const Row& row);
     friend std::ofstream& operator<<(std::ofstream& os, const Row& row);
+    friend class Parser;
 };
 
 enum DataType {
     eFILE = 0,
-    ePURE = 1
+    ePURE = 1,
+    eMMAP = 2  // fields are views into the mapped file, never written back (<file>.log is still applied)
+};
+
+// how a row changed since the last sync
+enum RowState {
+    eCLEAN = 0,
+    eDIRTY = 1,
+    eADDED = 2
+};
+
+enum SyncMode {
+    eREWRITE = 0,   // write the whole file to a temp file, then rename it over
+    eAPPEND_LOG = 1 // append the changes to <file>.log, replayed on the next load
 };
 
 class Parser
 {
 
 public:
-    Parser(const std::string&, const DataType& type = eFILE, char sep = ',');
+    Parser(const std::string&, const DataType& type = eFILE, char sep = ',', unsigned int threads = 1);
     ~Parser(void);
 
 public:
@@ -85,66 +585,111 @@ public:
     std::vector<std::string> getHeader(void) const;
     const std::string getHeaderElement(unsigned int pos) const;
     const std::string& getFileName(void) const;
+    std::string_view field(unsigned int row, unsigned int col) const;
+    ColumnView column(unsigned int col) const;
+    ColumnView column(const std::string& name) const;
+    // convert a whole column into out[0, rowCount()); see convertColumn below
+    template<typename T>
+    std::size_t convertColumn(unsigned int col, T* out, std::vector<unsigned int>* failed = nullptr, T fallback = T()) const;
+    const std::shared_ptr<const Schema>& schema(void) const;
+    Schema::Handle resolve(const std::string& name) const;
 
 public:
     bool deleteRow(unsigned int row);
     bool addRow(unsigned int pos, const std::vector<std::string>&);
     void sync(void) const;
+    void sync(SyncMode) const;
+    RowState rowState(unsigned int row) const;
+    std::size_t deletedCount(void) const;
+    bool modified(void) const;
+
+public:
+    // visit every record of a file, reading it in bounded blocks
+    template<typename Callback>
+    static std::size_t forEachRow(const std::string& path, Callback callback, char sep = ',', std::size_t blockSize = 1 << 20);
 
 protected:
-    void parseHeader(void);
-    void parseContent(void);
+    const char* parseHeader(const char*, const char*, std::size_t&);
+    void parseContent(const char*, const char*, std::size_t, unsigned int);
+    std::size_t parseChunk(const char*, const char*, std::size_t, std::vector<Column>&) const;
+    static const char* scanHeader(const char*, const char*, char, bool, std::size_t&, std::vector<std::string>&);
+    template<typename Sink>
+    static const char* scanRecords(const char*, const char*, char, bool, std::size_t&, std::vector<std::string_view>&, Sink);
+    void replayLog(void);
+    void noteSet(unsigned int, unsigned int, std::string_view);
+    std::string logFileName(void) const;
+    static void appendField(std::string&, std::string_view, char);
 
 private:
     std::string _file;
     const DataType _type;
     const char _sep;
-    std::vector<std::string> _originalFile;
-    std::vector<std::string> _header;
-    std::vector<Row*> _content;
+    std::string _buffer; // eFILE / ePURE input, the columns point into it
+    std::shared_ptr<const Schema> _schema;
+    std::vector<Column> _columns;
+    mutable std::vector<Row*> _content; // row facades, created on demand
+    std::unique_ptr<MappedFile> _mapping;
+    // changes since the last sync: the per-row state and, in log format, the edits themselves
+    mutable std::vector<unsigned char> _state;
+    mutable std::size_t _deleted;
+    mutable std::string _journal;
+    mutable bool _logged; // <file>.log holds changes the file does not
 
 public:
     Row& operator[](unsigned int row) const;
+    friend class Row;
 };
-Parser::Parser(const std::string& data, const DataType& type, char sep)
-    : _type(type), _sep(sep)
+Parser::Parser(const std::string& data, const DataType& type, char sep, unsigned int threads)
+    : _type(type), _sep(sep), _deleted(0), _logged(false)
 {
-    std::string line;
+    CSV_SCOPE(PARSER_CONSTRUCT);
+    const char* begin;
+    std::size_t size;
+
     if (type == eFILE)
     {
+        CSV_SCOPE(FILE_READ);
         _file = data;
-        std::ifstream ifile(_file.c_str());
+        std::ifstream ifile(_file.c_str(), std::ios::binary);
         if (ifile.is_open())
         {
-            while (ifile.good())
-            {
-                getline(ifile, line);
-                if (line != "")
-                    _originalFile.push_back(line);
-            }
+            ifile.seekg(0, std::ios::end);
+            _buffer.resize(static_cast<std::size_t>(ifile.tellg()));
+            ifile.seekg(0, std::ios::beg);
+            ifile.read(&_buffer[0], _buffer.size());
             ifile.close();
-
-            if (_originalFile.size() == 0)
-                throw Error(std::string("No Data in ").append(_file));
-
-            parseHeader();
-            parseContent();
         }
         else
             throw Error(std::string("Failed to open ").append(_file));
+        begin = _buffer.data();
+        size = _buffer.size();
+    }
+    else if (type == eMMAP)
+    {
+        _file = data;
+        _mapping.reset(new MappedFile(_file));
+        begin = _mapping->data();
+        size = _mapping->size();
     }
     else
     {
-        std::istringstream stream(data);
-        while (std::getline(stream, line))
-            if (line != "")
-                _originalFile.push_back(line);
-        if (_originalFile.size() == 0)
-            throw Error(std::string("No Data in pure content"));
-
-        parseHeader();
-        parseContent();
+        _buffer = data;
+        begin = _buffer.data();
+        size = _buffer.size();
     }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    CSV_COUNT(BYTES_READ, size);
+    std::size_t line = 1;
+    const char* content = parseHeader(begin, begin + size, line);
+    parseContent(content, begin + size, line, threads);
+    CSV_COUNT(ROWS_PARSED, _content.size());
+    _state.assign(_content.size(), eCLEAN);
+
+    if (type != ePURE)
+        replayLog();
 }
 
 Parser::~Parser(void)
@@ -155,485 +700,6199 @@ Parser::~Parser(void)
         delete* it;
 }
 
-void Parser::parseHeader(void)
-{
-    std::stringstream ss(_originalFile[0]);
-    std::string item;
-
-    while (std::getline(ss, item, _sep))
-        _header.push_back(item);
-}
-
-void Parser::parseContent(void)
+/*
+** Split the header, the first non-empty line, on the separator only.
+** Unless final, a header line without its newline is not taken yet.
+**
+** @return where the content starts, or nullptr if there is no header (yet)
+*/
+const char* Parser::scanHeader(const char* it, const char* end, char sep, bool final, std::size_t& line, std::vector<std::string>& header)
 {
-    std::vector<std::string>::iterator it;
+    std::size_t at = line;
 
-    it = _originalFile.begin();
-    it++; // skip header
-
-    for (; it != _originalFile.end(); it++)
+    while (it < end)
     {
-        bool quoted = false;
-        int tokenStart = 0;
-        unsigned int i = 0;
-
-        Row* row = new Row(_header);
-
-        for (; i != it->length(); i++)
+        const char* eol = static_cast<const char*>(std::memchr(it, '\n', end - it));
+        if (eol == nullptr)
         {
-            if (it->at(i) == '"')
-                quoted = ((quoted) ? (false) : (true));
-            else if (it->at(i) == ',' && !quoted)
-            {
-                row->push(it->substr(tokenStart, i - tokenStart));
-                tokenStart = i + 1;
-            }
+            if (!final)
+                return nullptr;
+            eol = end;
         }
 
-        //end
-        row->push(it->substr(tokenStart, it->length() - tokenStart));
-
-        // if value(s) missing
-        if (row->size() != _header.size())
-            throw Error("corrupted data !");
-        _content.push_back(row);
+        std::string_view text(it, eol - it);
+        it = eol + 1;
+        at++;
+        if (!text.empty() && text.back() == '\r')
+            text.remove_suffix(1);
+        if (text.empty())
+            continue;
+
+        std::size_t pos = 0;
+        for (std::size_t next; (next = text.find(sep, pos)) != std::string_view::npos; pos = next + 1)
+            header.emplace_back(text.substr(pos, next - pos));
+        if (pos < text.length())
+            header.emplace_back(text.substr(pos));
+        line = at;
+        return std::min(it, end);
     }
+    return nullptr;
 }
 
-Row& Parser::getRow(unsigned int rowPosition) const
-{
-    if (rowPosition < _content.size())
-        return *(_content[rowPosition]);
-    throw Error("can't return this row (doesn't exist)");
-}
-
-Row& Parser::operator[](unsigned int rowPosition) const
-{
-    return Parser::getRow(rowPosition);
-}
-
-unsigned int Parser::rowCount(void) const
-{
-    return _content.size();
-}
-
-unsigned int Parser::columnCount(void) const
+const char* Parser::parseHeader(const char* it, const char* end, std::size_t& line)
 {
-    return _header.size();
-}
+    std::vector<std::string> header;
+    const char* content = scanHeader(it, end, _sep, true, line, header);
 
-std::vector<std::string> Parser::getHeader(void) const
-{
-    return _header;
+    if (content == nullptr)
+    {
+        if (_type == ePURE)
+            throw Error(std::string("No Data in pure content"));
+        throw Error(std::string("No Data in ").append(_file));
+    }
+    _schema = std::make_shared<const Schema>(header);
+    return content;
 }
 
-const std::string Parser::getHeaderElement(unsigned int pos) const
+/*
+** Parse the records in [begin, end) into columns, several chunks at a
+** time when threads > 1:
+**   1. count quotes and newlines in equal slices of the buffer, so each
+**      slice knows whether it starts inside a quoted field, and on which line
+**   2. move every slice start to the next newline outside quotes
+**   3. parse the chunks on a worker pool into chunk-local columns, then
+**      stitch those together in file order
+*/
+void Parser::parseContent(const char* begin, const char* end, std::size_t line, unsigned int threads)
 {
-    if (pos >= _header.size())
-        throw Error("can't return this header (doesn't exist)");
-    return _header[pos];
-}
+    CSV_SCOPE(PARSE_CONTENT);
+    const std::size_t MIN_CHUNK = 1 << 20;
+    std::size_t size = end - begin;
+    std::size_t count = std::min<std::size_t>(threads * 4, size / MIN_CHUNK + 1);
+    const char* base = _mapping ? _mapping->data() : _buffer.data();
 
-bool Parser::deleteRow(unsigned int pos)
-{
-    if (pos < _content.size())
+    if (threads <= 1 || count <= 1)
     {
-        delete* (_content.begin() + pos);
-        _content.erase(_content.begin() + pos);
-        return true;
+        _columns.assign(_schema->size(), Column(base));
+        std::size_t bad = parseChunk(begin, end, line, _columns);
+        if (bad != 0)
+            throw Error(std::string("corrupted data at line ").append(std::to_string(bad)).append(" !"));
+        _content.assign(_columns[0].size(), nullptr);
+        return;
     }
-    return false;
-}
 
-bool Parser::addRow(unsigned int pos, const std::vector<std::string>& r)
-{
-    Row* row = new Row(_header);
+    WorkerPool pool(threads);
+    std::size_t slice = size / count;
+    std::vector<std::size_t> quotes(count), lines(count);
 
-    for (auto it = r.begin(); it != r.end(); it++)
-        row->push(*it);
-
-    if (pos <= _content.size())
+    // 1. quotes and newlines per slice
+    for (std::size_t k = 0; k < count; k++)
     {
-        _content.insert(_content.begin() + pos, row);
-        return true;
+        pool.submit([=, &quotes, &lines]() {
+            const char* from = begin + k * slice;
+            const char* to = (k == count - 1) ? end : from + slice;
+            quotes[k] = std::count(from, to, '"');
+            lines[k] = std::count(from, to, '\n');
+        });
     }
-    return false;
-}
+    pool.wait();
 
-void Parser::sync(void) const
-{
-    if (_type == DataType::eFILE)
+    // 2. chunk boundaries on record starts
+    std::vector<const char*> starts(count + 1, end);
+    std::vector<std::size_t> startLines(count + 1, 0);
+    std::size_t quotesBefore = 0;
+    std::size_t linesBefore = line;
+
+    starts[0] = begin;
+    startLines[0] = line;
+    for (std::size_t k = 1; k < count; k++)
     {
-        std::ofstream f;
-        f.open(_file, std::ios::out | std::ios::trunc);
+        quotesBefore += quotes[k - 1];
+        linesBefore += lines[k - 1];
 
-        // header
-        unsigned int i = 0;
-        for (auto it = _header.begin(); it != _header.end(); it++)
+        const char* it = begin + k * slice;
+        std::size_t at = linesBefore;
+        bool quoted = (quotesBefore % 2) != 0;
+        for (; it < end; it++)
         {
-            f << *it;
-            if (i < _header.size() - 1)
-                f << ",";
-            else
-                f << std::endl;
-            i++;
+            if (*it == '"')
+                quoted = !quoted;
+            else if (*it == '\n')
+            {
+                at++;
+                if (!quoted)
+                {
+                    it++;
+                    break;
+                }
+            }
         }
+        // a long quoted field can swallow whole slices
+        starts[k] = std::max(it, starts[k - 1]);
+        startLines[k] = (it < starts[k - 1]) ? startLines[k - 1] : at;
+    }
 
-        for (auto it = _content.begin(); it != _content.end(); it++)
-            f << **it << std::endl;
-        f.close();
+    // 3. parse, then stitch in order
+    std::vector<std::vector<Column> > parts(count, std::vector<Column>(_schema->size(), Column(base)));
+    std::vector<std::size_t> errors(count, 0);
+    for (std::size_t k = 0; k < count; k++)
+    {
+        pool.submit([=, &parts, &errors, &starts, &startLines]() {
+            errors[k] = parseChunk(starts[k], starts[k + 1], startLines[k], parts[k]);
+        });
     }
-}
+    pool.wait();
 
-const std::string& Parser::getFileName(void) const
-{
-    return _file;
+    for (std::size_t k = 0; k < count; k++)
+        if (errors[k] != 0)
+            throw Error(std::string("corrupted data at line ").append(std::to_string(errors[k])).append(" !"));
+
+    _columns.assign(_schema->size(), Column(base));
+    for (std::size_t col = 0; col < _columns.size(); col++)
+    {
+        std::size_t rows = 0;
+        for (std::size_t k = 0; k < count; k++)
+            rows += parts[k][col].size();
+        _columns[col].reserve(rows);
+        for (std::size_t k = 0; k < count; k++)
+            _columns[col].append(parts[k][col]);
+    }
+    _content.assign(_columns[0].size(), nullptr);
 }
 
 /*
-** ROW
+** Walk the records in [begin, end). A record ends at a newline outside
+** quotes; empty records are skipped. sink(values, line) gets every other
+** record and returns false to stop the walk. Unless final, a trailing
+** record without its newline is left for the next call.
+**
+** @return where the next record starts (line is updated to match), or
+**         nullptr if the sink stopped the walk
 */
+template<typename Sink>
+const char* Parser::scanRecords(const char* begin, const char* end, char sep, bool final, std::size_t& line, std::vector<std::string_view>& values, Sink sink)
+{
+    StructuralScanner scanner(begin, end, sep);
+    const char* tokenStart = begin;
+    const char* recordStart = begin;
+    std::size_t recordLine = line;
 
-Row::Row(const std::vector<std::string>& header)
-    : _header(header) {}
+    values.clear();
 
-Row::~Row(void) {}
+    while (true)
+    {
+        const char* it = scanner.next();
 
-unsigned int Row::size(void) const
-{
-    return _values.size();
+        if (it < end && *it == sep)
+        {
+            values.push_back(std::string_view(tokenStart, it - tokenStart));
+            tokenStart = it + 1;
+            continue;
+        }
+        if (it == end && !final)
+            break;
+
+        //end
+        std::string_view last(tokenStart, it - tokenStart);
+        if (!last.empty() && last.back() == '\r')
+            last.remove_suffix(1);
+
+        if (!values.empty() || !last.empty())
+        {
+            values.push_back(last);
+            if (!sink(values, recordLine))
+                return nullptr;
+            values.clear();
+        }
+
+        if (it == end)
+        {
+            recordStart = end;
+            recordLine = line + scanner.newlinesBefore(end);
+            break;
+        }
+        tokenStart = recordStart = it + 1;
+        recordLine = line + scanner.newlinesBefore(it) + 1;
+    }
+
+    values.clear();
+    line = recordLine;
+    return recordStart;
 }
 
-void Row::push(const std::string& value)
+/*
+** Tokenize the records in [begin, end) into columns.
+**
+** @return 0, or the line of the first record with a wrong field count
+*/
+std::size_t Parser::parseChunk(const char* begin, const char* end, std::size_t line, std::vector<Column>& columns) const
 {
-    _values.push_back(value);
+    std::vector<std::string_view> values;
+    std::size_t bad = 0;
+
+    values.reserve(columns.size());
+    scanRecords(begin, end, _sep, true, line, values, [&columns, &bad](const std::vector<std::string_view>& record, std::size_t at) {
+        // if value(s) missing
+        if (record.size() != columns.size())
+        {
+            bad = at;
+            return false;
+        }
+        for (std::size_t i = 0; i < record.size(); i++)
+            columns[i].pushView(record[i]);
+        return true;
+    });
+    return bad;
 }
 
-bool Row::set(const std::string& key, const std::string& value)
+/*
+** Stream a file through callback(const RecordView&) one record at a
+** time. Only one block (grown if a single record is larger) is held in
+** memory, so files bigger than RAM can be processed in one pass.
+**
+** A <file>.log (see sync) is applied like the constructor does. Its edits
+** address rows by position, so then the whole file is mapped and replayed
+** first, and line() is the row's position counted from 2, the first line
+** after the header.
+**
+** @return the number of records visited
+*/
+template<typename Callback>
+std::size_t Parser::forEachRow(const std::string& path, Callback callback, char sep, std::size_t blockSize)
 {
-    std::vector<std::string>::const_iterator it;
-    int pos = 0;
+    CSV_SCOPE(FOR_EACH_ROW);
+    std::error_code ec;
+    if (std::filesystem::exists(path + ".log", ec))
+    {
+        Parser parser(path, eMMAP, sep);
+        std::vector<std::string_view> fields(parser.columnCount());
+        RecordView record(*parser._schema);
+        record._values = &fields;
+        for (unsigned int row = 0; row < parser.rowCount(); row++)
+        {
+            for (unsigned int col = 0; col < fields.size(); col++)
+                fields[col] = parser._columns[col][row];
+            record._line = row + 2;
+            callback(record);
+        }
+        return parser.rowCount();
+    }
 
-    for (it = _header.begin(); it != _header.end(); it++)
+    std::ifstream ifile(path.c_str(), std::ios::binary);
+    if (!ifile.is_open())
+        throw Error(std::string("Failed to open ").append(path));
+
+    std::vector<char> buffer(std::max<std::size_t>(blockSize, 64));
+    std::vector<std::string_view> values;
+    std::shared_ptr<const Schema> schema;
+    std::unique_ptr<RecordView> record;
+    std::size_t used = 0;
+    std::size_t rows = 0;
+    std::size_t line = 1;
+
+    while (true)
     {
-        if (key == *it)
+        // one record larger than the whole buffer
+        if (used == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        {
+            CSV_SCOPE(FILE_READ);
+            ifile.read(buffer.data() + used, buffer.size() - used);
+        }
+        used += static_cast<std::size_t>(ifile.gcount());
+        CSV_COUNT(BYTES_READ, ifile.gcount());
+        bool final = !ifile;
+
+        const char* begin = buffer.data();
+        const char* end = begin + used;
+
+        if (!schema)
         {
-            _values[pos] = value;
+            std::vector<std::string> header;
+            const char* content = scanHeader(begin, end, sep, final, line, header);
+            if (content == nullptr)
+            {
+                if (final)
+                    throw Error(std::string("No Data in ").append(path));
+                continue;
+            }
+            schema = std::make_shared<const Schema>(header);
+            record.reset(new RecordView(*schema));
+            begin = content;
+        }
+
+        begin = scanRecords(begin, end, sep, final, line, values, [&](const std::vector<std::string_view>& fields, std::size_t at) {
+            // if value(s) missing
+            if (fields.size() != schema->size())
+                throw Error(std::string("corrupted data at line ").append(std::to_string(at)).append(" !"));
+            record->_values = &fields;
+            record->_line = at;
+            callback(*record);
+            rows++;
             return true;
+        });
+
+        if (final)
+            break;
+
+        // keep the unfinished record for the next block
+        used = end - begin;
+        std::memmove(buffer.data(), begin, used);
+    }
+    CSV_COUNT(ROWS_PARSED, rows);
+    return rows;
+}
+
+/*
+** Convert every value of a column in one pass, e.g. a price column into
+** doubles. Cells that do not convert get fallback and their rows are
+** appended to failed, when given.
+**
+** @param out room for rowCount() values
+** @return the number of cells that did not convert
+*/
+template<typename T>
+std::size_t Parser::convertColumn(unsigned int col, T* out, std::vector<unsigned int>* failed, T fallback) const
+{
+    std::size_t errors = 0;
+    unsigned int row = 0;
+
+    for (std::string_view text : column(col))
+    {
+        if (!convertField(text, out[row]))
+        {
+            out[row] = fallback;
+            errors++;
+            if (failed != nullptr)
+                failed->push_back(row);
         }
-        pos++;
+        row++;
     }
-    return false;
+    return errors;
 }
 
-const std::string Row::operator[](unsigned int valuePosition) const
+/*
+** SCHEMA BINDING
+**
+** Binds the columns of a file to the members of a struct at compile time,
+** by header name. A binding type lists its fields once:
+**
+**   struct CourseColumns
+**   {
+**       typedef Course Record;
+**       static constexpr auto fields(void)
+**       {
+**           return std::make_tuple(bindField("courseId", &Course::courseId), ...);
+**       }
+**   };
+**
+** RecordParser<CourseColumns> then hands out Course records, either
+** from a Parser that already holds the whole file (mapped, split in
+** parallel chunks) or streamed like forEachRow in bounded memory, both
+** with <file>.log applied. The header is matched against the names once,
+** and each value is converted straight into its member. Columns may come
+** in any order and names match loosely (see normalizeName). A header
+** missing any of them is an error before any record.
+*/
+
+template<typename Record, typename T>
+struct FieldBinding
 {
-    if (valuePosition < _values.size())
-        return _values[valuePosition];
-    throw Error("can't return this value (doesn't exist)");
+    const char* name;
+    T Record::* member;
+};
+
+template<typename Record, typename T>
+constexpr FieldBinding<Record, T> bindField(const char* name, T Record::* member)
+{
+    return FieldBinding<Record, T>{ name, member };
 }
 
-const std::string Row::operator[](const std::string& key) const
+template<typename Binding>
+class RecordParser
+{
+public:
+    typedef typename Binding::Record Record;
+    static constexpr std::size_t FIELD_COUNT = std::tuple_size<decltype(Binding::fields())>::value;
+
+    RecordParser(char sep = ',') : _sep(sep) {}
+
+public:
+    template<typename Callback>
+    std::size_t forEachRecord(const Parser&, Callback) const;
+    template<typename Callback>
+    std::size_t forEachRecord(const std::string&, Callback, std::size_t blockSize = 1 << 20) const;
+
+private:
+    typedef std::array<unsigned int, FIELD_COUNT> Columns;
+    typedef std::array<std::string_view, FIELD_COUNT> Values;
+
+    static std::string normalizeName(std::string_view);
+    template<std::size_t... I>
+    static void resolve(const Schema&, Columns&, std::index_sequence<I...>);
+    template<std::size_t... I>
+    static void convert(const Values&, const char*, std::size_t, Record&, std::index_sequence<I...>);
+    template<typename T>
+    static void convertOne(std::string_view, const char*, std::size_t, const FieldBinding<Record, T>&, Record&);
+
+private:
+    const char _sep;
+};
+
+/*
+** Visit every row of a parsed file as callback(Record&), in order. Text
+** members (std::string_view) point into the parser and are valid as long
+** as it is.
+**
+** @return the number of records visited
+*/
+template<typename Binding>
+template<typename Callback>
+std::size_t RecordParser<Binding>::forEachRecord(const Parser& parser, Callback callback) const
 {
-    std::vector<std::string>::const_iterator it;
-    int pos = 0;
+    Columns columns;
+    resolve(*parser.schema(), columns, std::make_index_sequence<FIELD_COUNT>());
 
-    for (it = _header.begin(); it != _header.end(); it++)
+    std::vector<ColumnView> views;
+    for (std::size_t i = 0; i < FIELD_COUNT; i++)
+        views.push_back(parser.column(columns[i]));
+
+    const std::size_t rows = parser.rowCount();
+    Values values;
+    for (std::size_t row = 0; row < rows; row++)
     {
-        if (key == *it)
-            return _values[pos];
-        pos++;
+        for (std::size_t i = 0; i < FIELD_COUNT; i++)
+            values[i] = views[i][row];
+        Record record;
+        convert(values, "row", row + 1, record, std::make_index_sequence<FIELD_COUNT>());
+        callback(record);
     }
+    return rows;
+}
 
-    throw Error("can't return this value (doesn't exist)");
+/*
+** Stream a file through callback(Record&) one record at a time. Text
+** members (std::string_view) keep the value exactly as in the file and
+** point into the read buffer, so they are only valid during the callback.
+**
+** @return the number of records visited
+*/
+template<typename Binding>
+template<typename Callback>
+std::size_t RecordParser<Binding>::forEachRecord(const std::string& path, Callback callback, std::size_t blockSize) const
+{
+    Columns columns;
+    const Schema* resolved = nullptr;
+    Values values;
+
+    return Parser::forEachRow(path, [&](const RecordView& row) {
+        if (resolved != &row.schema())
+        {
+            resolve(row.schema(), columns, std::make_index_sequence<FIELD_COUNT>());
+            resolved = &row.schema();
+        }
+        for (std::size_t i = 0; i < FIELD_COUNT; i++)
+            values[i] = row.values()[columns[i]];
+        Record record;
+        convert(values, "line", row.line(), record, std::make_index_sequence<FIELD_COUNT>());
+        callback(record);
+    }, _sep, blockSize);
 }
 
-std::ostream& operator<<(std::ostream& os, const Row& row)
+// a header name as hand-edited or spreadsheet files write it: no UTF-8
+// byte order mark, surrounding blanks or quotes, ASCII case folded
+template<typename Binding>
+std::string RecordParser<Binding>::normalizeName(std::string_view name)
 {
-    for (unsigned int i = 0; i != row._values.size(); i++)
-        os << row._values[i] << " | ";
+    if (name.substr(0, 3) == "\xEF\xBB\xBF")
+        name.remove_prefix(3);
+    while (!name.empty() && (name.front() == ' ' || name.front() == '\t' || name.front() == '"'))
+        name.remove_prefix(1);
+    while (!name.empty() && (name.back() == ' ' || name.back() == '\t' || name.back() == '\r' || name.back() == '"'))
+        name.remove_suffix(1);
+
+    std::string folded(name);
+    for (char& c : folded)
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    return folded;
+}
 
-    return os;
+/*
+** The column of every bound field, by normalized name. Fields never
+** bind by position: a header that names them differently could list
+** them in another order, and its records would load into the wrong
+** members without a word.
+**
+** @throw Error naming the first field missing from the header
+*/
+template<typename Binding>
+template<std::size_t... I>
+void RecordParser<Binding>::resolve(const Schema& schema, Columns& columns, std::index_sequence<I...>)
+{
+    constexpr auto fields = Binding::fields();
+    const char* const names[] = { std::get<I>(fields).name... };
+    const unsigned int NONE = static_cast<unsigned int>(-1);
+
+    std::vector<std::string> header;
+    for (unsigned int col = 0; col < schema.size(); col++)
+        header.push_back(normalizeName(schema.name(col)));
+
+    for (std::size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        std::string name = normalizeName(names[i]);
+        columns[i] = NONE;
+        for (unsigned int col = 0; col < header.size() && columns[i] == NONE; col++)
+            if (header[col] == name)
+                columns[i] = col;
+        if (columns[i] == NONE)
+            throw Error(std::string("missing column ").append(names[i]).append(" in the header"));
+    }
 }
 
-std::ofstream& operator<<(std::ofstream& os, const Row& row)
+template<typename Binding>
+template<std::size_t... I>
+void RecordParser<Binding>::convert(const Values& values, const char* unit, std::size_t at, Record& record, std::index_sequence<I...>)
 {
-    for (unsigned int i = 0; i != row._values.size(); i++)
+    constexpr auto fields = Binding::fields();
+    (convertOne(values[I], unit, at, std::get<I>(fields), record), ...);
+}
+
+// one value into its member; unit and at say where it came from, for the error
+template<typename Binding>
+template<typename T>
+void RecordParser<Binding>::convertOne(std::string_view value, const char* unit, std::size_t at, const FieldBinding<Record, T>& field, Record& record)
+{
+    if constexpr (std::is_same<T, std::string_view>::value)
+        record.*(field.member) = value;
+    else if (!convertField(value, record.*(field.member)))
+        throw Error(std::string("can't convert ").append(value).append(" in column ").append(field.name)
+            .append(" at ").append(unit).append(1, ' ').append(std::to_string(at)));
+}
+
+Row& Parser::getRow(unsigned int rowPosition) const
+{
+    if (rowPosition < _content.size())
     {
-        os << row._values[i];
-        if (i < row._values.size() - 1)
-            os << ",";
+        // getRow() has always handed out writable rows
+        if (_content[rowPosition] == nullptr)
+            _content[rowPosition] = new Row(_schema, const_cast<Parser*>(this), rowPosition);
+        return *(_content[rowPosition]);
     }
-    return os;
+    throw Error("can't return this row (doesn't exist)");
 }
 
+std::string_view Parser::field(unsigned int rowPosition, unsigned int col) const
+{
+    if (rowPosition >= _content.size() || col >= _columns.size())
+        throw Error("can't return this value (doesn't exist)");
+    return _columns[col][rowPosition];
+}
 
-//============================================================================
-// Global definitions visible to all methods and classes
-//============================================================================
+ColumnView Parser::column(unsigned int col) const
+{
+    if (col >= _columns.size())
+        throw Error("can't return this column (doesn't exist)");
+    return ColumnView(_columns[col]);
+}
 
-// forward declarations
-double strToDouble(string str, char ch);
+ColumnView Parser::column(const std::string& name) const
+{
+    return ColumnView(_columns[_schema->resolve(name).index]);
+}
 
-// define a structure to hold course information
-struct Course {
-    string courseId; // unique identifier
-    string title;
-    string prerequisites;
-    double amount;
-    Course() {
-        amount = 0.0;
+const std::shared_ptr<const Schema>& Parser::schema(void) const
+{
+    return _schema;
+}
+
+Schema::Handle Parser::resolve(const std::string& name) const
+{
+    return _schema->resolve(name);
+}
+
+Row& Parser::operator[](unsigned int rowPosition) const
+{
+    return Parser::getRow(rowPosition);
+}
+
+unsigned int Parser::rowCount(void) const
+{
+    return _content.size();
+}
+
+unsigned int Parser::columnCount(void) const
+{
+    return _schema->size();
+}
+
+std::vector<std::string> Parser::getHeader(void) const
+{
+    return _schema->names();
+}
+
+const std::string Parser::getHeaderElement(unsigned int pos) const
+{
+    if (pos >= _schema->size())
+        throw Error("can't return this header (doesn't exist)");
+    return _schema->name(pos);
+}
+
+bool Parser::deleteRow(unsigned int pos)
+{
+    if (pos < _content.size())
+    {
+        for (auto it = _columns.begin(); it != _columns.end(); it++)
+            it->erase(pos);
+        delete* (_content.begin() + pos);
+        _content.erase(_content.begin() + pos);
+
+        if (_state[pos] != eADDED)
+            _deleted++;
+        _state.erase(_state.begin() + pos);
+        _journal.append("del").append(1, _sep).append(std::to_string(pos)).append(1, '\n');
+
+        // rows below moved up by one
+        for (auto it = _content.begin() + pos; it != _content.end(); it++)
+            if (*it != nullptr)
+                (*it)->_index--;
+        return true;
     }
-};
-vector<Course> courses;
-//============================================================================
-// Static methods used for testing
-//============================================================================
+    return false;
+}
 
-/**
- * Display the course information to the console (std::out)
- *
- * @param course struct containing the course info
- */
-void displayCourse(Course course) {
-    std::cout << course.title << ": " << course.courseId << " | " << course.amount << " | "
-        << course.prerequisites << endl;
-    return;
+bool Parser::addRow(unsigned int pos, const std::vector<std::string>& r)
+{
+    if (pos <= _content.size() && r.size() == _columns.size())
+    {
+        for (unsigned int i = 0; i < r.size(); i++)
+            _columns[i].insert(pos, r[i]);
+        _content.insert(_content.begin() + pos, nullptr);
+
+        _state.insert(_state.begin() + pos, eADDED);
+        _journal.append("add").append(1, _sep).append(std::to_string(pos));
+        for (unsigned int i = 0; i < r.size(); i++)
+        {
+            _journal.append(1, _sep);
+            appendField(_journal, r[i], _sep);
+        }
+        _journal.append(1, '\n');
+
+        // rows below moved down by one
+        for (auto it = _content.begin() + pos + 1; it != _content.end(); it++)
+            if (*it != nullptr)
+                (*it)->_index++;
+        return true;
+    }
+    return false;
+}
+
+void Parser::sync(void) const
+{
+    sync(eREWRITE);
 }
-/**
-* Search for the specified bidId
-*
-* @param bidId The bid id to search for
-*/
-Course SearchCourse(string courseId) {
-    Course course;
 
-    // FIXME (8): Implement logic to search for and return a bid
+/*
+** Write the changes back, eFILE only.
+**
+** eREWRITE writes the whole file in large blocks to <file>.tmp and renames
+** it over the file, so a reader sees either the old or the new file, then
+** drops the change log. eAPPEND_LOG only appends the edits made since the
+** last sync to <file>.log, one write for all of them; cheap for small edits
+** to big files, the next eREWRITE folds the log back in.
+*/
+void Parser::sync(SyncMode mode) const
+{
+    if (_type != DataType::eFILE || (!modified() && !(mode == eREWRITE && _logged)))
+        return;
 
-        // FIXME (6): Implement logic to print all bids
+    if (mode == eAPPEND_LOG)
+    {
+        std::ofstream log(logFileName(), std::ios::out | std::ios::app | std::ios::binary);
+        log.write(_journal.data(), _journal.size());
+        if (!log.flush())
+            throw Error(std::string("Failed to write ").append(logFileName()));
+        _logged = true;
+    }
+    else
+    {
+        const std::size_t BLOCK_SIZE = 1 << 20;
+        std::string temp = _file + ".tmp";
+        std::ofstream f(temp, std::ios::out | std::ios::trunc | std::ios::binary);
+        std::string block;
+        block.reserve(BLOCK_SIZE + 4096);
 
-    unsigned int idx = 0;
+        // header
+        for (unsigned int i = 0; i < _schema->size(); i++)
+        {
+            block.append(_schema->name(i));
+            block.append(1, i < _schema->size() - 1 ? _sep : '\n');
+        }
 
-    //Iterate the loop
-    for (int i = 0; i < courses.size(); ++i) {
-        if (courses[i].courseId._Equal(courseId))
+        for (unsigned int row = 0; row < _content.size(); row++)
         {
-            return courses[i];
+            for (unsigned int col = 0; col < _columns.size(); col++)
+            {
+                std::string_view value = _columns[col][row];
+                block.append(value.data(), value.size());
+                if (col < _columns.size() - 1)
+                    block.append(1, _sep);
+            }
+            block.append(1, '\n');
+
+            if (block.size() >= BLOCK_SIZE)
+            {
+                f.write(block.data(), block.size());
+                block.clear();
+            }
         }
+        f.write(block.data(), block.size());
+        f.close();
+        if (!f)
+            throw Error(std::string("Failed to write ").append(temp));
+
+        std::error_code ec;
+        std::filesystem::rename(temp, _file, ec);
+        if (ec)
+            throw Error(std::string("Failed to replace ").append(_file));
+        std::filesystem::remove(logFileName(), ec);
+        _logged = false;
     }
-    return course;
+
+    _journal.clear();
+    _state.assign(_content.size(), eCLEAN);
+    _deleted = 0;
 }
-/**
- * Load a CSV file containing courses into a container
- *
- * @param csvPath the path to the CSV file to load
- * @return a container holding all the courses read
- */
-vector<Course> loadCourses(string csvPath) {
-    std::cout << "Loading CSV file " << csvPath << endl;
 
-    // Define a vector data structure to hold a collection of courses.
-    vector<Course> courses;
+RowState Parser::rowState(unsigned int row) const
+{
+    if (row >= _state.size())
+        throw Error("can't return this row (doesn't exist)");
+    return static_cast<RowState>(_state[row]);
+}
 
-    // initialize the CSV Parser using the given path
-    Parser file = Parser(csvPath);
+// rows of the last synced file deleted since
+std::size_t Parser::deletedCount(void) const
+{
+    return _deleted;
+}
 
-    try {
-        // loop to read rows of a CSV file
-        for (int i = 0; i < file.rowCount(); i++) {
+bool Parser::modified(void) const
+{
+    return !_journal.empty();
+}
 
-            // Create a data structure and add to the collection of courses
-            Course course;
-            // JOE course.courseId = file[i][1];
-            // JOE course.title = file[i][0];
+std::string Parser::logFileName(void) const
+{
+    return _file + ".log";
+}
+
+// record a Row::set on a bound row
+void Parser::noteSet(unsigned int row, unsigned int col, std::string_view value)
+{
+    if (_state[row] == eCLEAN)
+        _state[row] = eDIRTY;
+    _journal.append("set").append(1, _sep).append(std::to_string(row)).append(1, _sep).append(std::to_string(col)).append(1, _sep);
+    appendField(_journal, value, _sep);
+    _journal.append(1, '\n');
+}
+
+// a value as one log field, quoted when it holds a separator, quote or newline
+void Parser::appendField(std::string& out, std::string_view value, char sep)
+{
+    if (value.find_first_of(std::string{ sep, '"', '\n', '\r' }) == std::string_view::npos)
+    {
+        out.append(value.data(), value.size());
+        return;
+    }
+    out.append(1, '"');
+    for (char c : value)
+    {
+        if (c == '"')
+            out.append(1, '"');
+        out.append(1, c);
+    }
+    out.append(1, '"');
+}
 
-            course.title = file[i][1];
-            course.courseId = file[i][0];
+/*
+** Apply <file>.log, if there is one, on top of the freshly parsed file,
+** mapped or read. The rows are then clean again: file and log together
+** hold them. Only the columns the log touches are copied out of a mapping.
+*/
+void Parser::replayLog(void)
+{
+    std::ifstream ifile(logFileName().c_str(), std::ios::binary);
+    if (!ifile.is_open())
+        return;
+    std::string log((std::istreambuf_iterator<char>(ifile)), std::istreambuf_iterator<char>());
+    ifile.close();
+
+    auto unquote = [](std::string_view field) {
+        std::string value;
+        if (field.size() < 2 || field.front() != '"' || field.back() != '"')
+            return value.assign(field.data(), field.size());
+        for (std::size_t i = 1; i + 1 < field.size(); i++)
+        {
+            value.append(1, field[i]);
+            if (field[i] == '"')
+                i++;
+        }
+        return value;
+    };
+    auto index = [](std::string_view field, unsigned int& out) {
+        return convertField(field, out);
+    };
+
+    std::size_t line = 1;
+    std::vector<std::string_view> values;
+    scanRecords(log.data(), log.data() + log.size(), _sep, true, line, values, [&](const std::vector<std::string_view>& fields, std::size_t at) {
+        unsigned int row, col;
+        bool ok = fields.size() >= 2 && index(fields[1], row);
+
+        if (ok && fields[0] == "set")
+        {
+            ok = fields.size() == 4 && index(fields[2], col) && row < _content.size() && col < _columns.size();
+            if (ok)
+                _columns[col].assign(row, unquote(fields[3]));
+        }
+        else if (ok && fields[0] == "add")
+        {
+            std::vector<std::string> r;
+            for (std::size_t i = 2; i < fields.size(); i++)
+                r.push_back(unquote(fields[i]));
+            ok = addRow(row, r);
+        }
+        else if (ok && fields[0] == "del")
+            ok = fields.size() == 2 && deleteRow(row);
+        else
+            ok = false;
 
+        if (!ok)
+            throw Error(std::string("corrupted change log at line ").append(std::to_string(at)).append(" !"));
+        return true;
+    });
 
-            course.prerequisites = file[i][2];
-            //course.amount = strToDouble(file[i][4], '$');
+    _journal.clear();
+    _state.assign(_content.size(), eCLEAN);
+    _deleted = 0;
+    _logged = true;
+}
 
-            cout << "Item: " << course.title << ", prerequisites: " << course.prerequisites << ", Amount: " << course.amount << endl;
+const std::string& Parser::getFileName(void) const
+{
+    return _file;
+}
 
-            // push this course to the end
-            courses.push_back(course);
+/*
+** METRICS
+*/
+
+std::atomic<bool> Metrics::_enabled(false);
+std::atomic<std::uint64_t> Metrics::_counters[Metrics::COUNTER_COUNT];
+Metrics::Histogram Metrics::_timers[Metrics::TIMER_COUNT];
+
+const char* const Metrics::_counterNames[Metrics::COUNTER_COUNT] = {
+    "bytesRead", "rowsParsed", "allocations", "allocatedBytes",
+    "sortComparisons", "sortSwaps", "searchLookups", "searchProbes"
+};
+
+const char* const Metrics::_timerNames[Metrics::TIMER_COUNT] = {
+    "parserConstruct", "fileRead", "parseContent", "forEachRow",
+    "loadCourses", "quickSort", "selectionSort", "keySort", "searchCourse",
+    "fuzzySearch", "keywordSearch"
+};
+
+void Metrics::enable(bool on)
+{
+    _enabled.store(on, std::memory_order_relaxed);
+}
+
+void Metrics::add(Counter counter, std::uint64_t count)
+{
+    _counters[counter].fetch_add(count, std::memory_order_relaxed);
+}
+
+void Metrics::record(Timer timer, std::uint64_t nanoseconds)
+{
+    Histogram& h = _timers[timer];
+    int bucket = 0;
+
+    while (bucket < BUCKETS - 1 && (nanoseconds >> (bucket + 1)) != 0)
+        bucket++;
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.total.fetch_add(nanoseconds, std::memory_order_relaxed);
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t seen = h.max.load(std::memory_order_relaxed);
+    while (seen < nanoseconds && !h.max.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed))
+        ;
+}
+
+void Metrics::reset(void)
+{
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        _counters[i].store(0, std::memory_order_relaxed);
+    for (int i = 0; i < TIMER_COUNT; i++)
+    {
+        _timers[i].count.store(0, std::memory_order_relaxed);
+        _timers[i].total.store(0, std::memory_order_relaxed);
+        _timers[i].max.store(0, std::memory_order_relaxed);
+        for (int b = 0; b < BUCKETS; b++)
+            _timers[i].buckets[b].store(0, std::memory_order_relaxed);
+    }
+}
+
+// upper bound of the bucket holding the p-th percentile, in ms
+double Metrics::percentile(const Histogram& h, double p)
+{
+    std::uint64_t count = h.count.load(std::memory_order_relaxed);
+    std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * count + 0.999999);
+    std::uint64_t seen = 0;
+
+    for (int b = 0; b < BUCKETS && count != 0; b++)
+    {
+        seen += h.buckets[b].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min<double>(std::ldexp(1.0, b + 1), h.max.load(std::memory_order_relaxed)) / 1e6;
+    }
+    return 0.0;
+}
+
+// tokenizing cost per MB read, Parser and streaming loads together
+double Metrics::parseMsPerMb(void)
+{
+    double mb = _counters[BYTES_READ].load(std::memory_order_relaxed) / 1048576.0;
+    double ns = static_cast<double>(_timers[PARSE_CONTENT].total.load(std::memory_order_relaxed)
+        + _timers[FOR_EACH_ROW].total.load(std::memory_order_relaxed));
+    return mb > 0 ? ns / 1e6 / mb : 0.0;
+}
+
+void Metrics::dump(std::ostream& os)
+{
+    os << "counters" << std::endl;
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        os << "  " << std::left << std::setw(18) << _counterNames[i] << _counters[i].load(std::memory_order_relaxed) << std::endl;
+
+    os << "timers (ms)          count      total        p50        p99        max" << std::endl;
+    for (int i = 0; i < TIMER_COUNT; i++)
+    {
+        const Histogram& h = _timers[i];
+        os << "  " << std::left << std::setw(16) << _timerNames[i] << std::right << std::fixed << std::setprecision(3)
+            << std::setw(9) << h.count.load(std::memory_order_relaxed)
+            << std::setw(11) << h.total.load(std::memory_order_relaxed) / 1e6
+            << std::setw(11) << percentile(h, 50)
+            << std::setw(11) << percentile(h, 99)
+            << std::setw(11) << h.max.load(std::memory_order_relaxed) / 1e6 << std::endl;
+    }
+    os << "parse ms per MB      " << parseMsPerMb() << std::endl;
+    os.unsetf(std::ios::fixed);
+}
+
+// the same numbers as dump(), as one JSON object
+std::string Metrics::json(void)
+{
+    std::ostringstream os;
+
+    os << "{\"enabled\":" << (enabled() ? "true" : "false") << ",\"counters\":{";
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        os << (i ? "," : "") << "\"" << _counterNames[i] << "\":" << _counters[i].load(std::memory_order_relaxed);
+    os << "},\"timers\":{";
+    for (int i = 0; i < TIMER_COUNT; i++)
+    {
+        const Histogram& h = _timers[i];
+        os << (i ? "," : "") << "\"" << _timerNames[i] << "\":{\"count\":" << h.count.load(std::memory_order_relaxed)
+            << ",\"totalMs\":" << h.total.load(std::memory_order_relaxed) / 1e6
+            << ",\"p50Ms\":" << percentile(h, 50)
+            << ",\"p99Ms\":" << percentile(h, 99)
+            << ",\"maxMs\":" << h.max.load(std::memory_order_relaxed) / 1e6
+            << ",\"buckets\":[";
+        // log2 ns buckets, trailing empty ones left out
+        int last = BUCKETS;
+        while (last > 0 && h.buckets[last - 1].load(std::memory_order_relaxed) == 0)
+            last--;
+        for (int b = 0; b < last; b++)
+            os << (b ? "," : "") << h.buckets[b].load(std::memory_order_relaxed);
+        os << "]}";
+    }
+    os << "},\"parseMsPerMb\":" << parseMsPerMb() << "}";
+    return os.str();
+}
+
+MetricScope::MetricScope(Metrics::Timer timer)
+    : _timer(timer), _active(Metrics::enabled())
+{
+    if (_active)
+        _start = std::chrono::steady_clock::now();
+}
+
+MetricScope::~MetricScope(void)
+{
+    if (_active)
+        Metrics::record(_timer, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _start).count()));
+}
+
+#if CSV_METRICS && CSV_COUNT_ALLOCATIONS
+// every heap allocation of the program passes here; new and delete are
+// replaced together, so GCC's malloc/free pairing warning does not apply
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size)
+{
+    if (Metrics::enabled())
+    {
+        Metrics::add(Metrics::ALLOCATIONS);
+        Metrics::add(Metrics::ALLOCATED_BYTES, size);
+    }
+    void* p = std::malloc(size != 0 ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+// replaced too, so that no allocation reaches free() from another allocator
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    if (Metrics::enabled())
+    {
+        Metrics::add(Metrics::ALLOCATIONS);
+        Metrics::add(Metrics::ALLOCATED_BYTES, size);
+    }
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+/*
+** WORKER POOL
+*/
+
+WorkerPool::WorkerPool(unsigned int threads)
+    : _pending(0), _stop(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    // the thread calling wait() works too
+    for (unsigned int i = 1; i < threads; i++)
+        _threads.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _ready.notify_all();
+    for (auto it = _threads.begin(); it != _threads.end(); it++)
+        it->join();
+}
+
+unsigned int WorkerPool::size(void) const
+{
+    return _threads.size() + 1;
+}
+
+void WorkerPool::submit(std::function<void(void)> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+        _pending++;
+    }
+    _ready.notify_one();
+}
+
+// pop and run one task, lock held on entry and on return
+void WorkerPool::run(std::unique_lock<std::mutex>& lock)
+{
+    std::function<void(void)> task = std::move(_tasks.front());
+    _tasks.pop_front();
+    lock.unlock();
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        lock.lock();
+        if (!_error)
+            _error = std::current_exception();
+        lock.unlock();
+    }
+    lock.lock();
+    if (--_pending == 0)
+        _done.notify_all();
+}
+
+void WorkerPool::work(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _ready.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+        if (_tasks.empty())
+            return;
+        run(lock);
+    }
+}
+
+void WorkerPool::wait(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_pending != 0)
+    {
+        if (!_tasks.empty())
+            run(lock);
+        else
+            _done.wait(lock, [this]() { return _pending == 0 || !_tasks.empty(); });
+    }
+
+    std::exception_ptr error = _error;
+    _error = nullptr;
+    lock.unlock();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/*
+** MAPPED FILE
+*/
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& path)
+    : _data(nullptr), _size(0), _handle(INVALID_HANDLE_VALUE), _mapping(NULL)
+{
+    _handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_handle == INVALID_HANDLE_VALUE)
+        throw Error(std::string("Failed to open ").append(path));
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_handle, &size))
+    {
+        CloseHandle(_handle);
+        throw Error(std::string("Failed to open ").append(path));
+    }
+    _size = static_cast<std::size_t>(size.QuadPart);
+    if (_size == 0)
+        return;
+
+    _mapping = CreateFileMappingA(_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping != NULL)
+        _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_data == nullptr)
+    {
+        if (_mapping != NULL)
+            CloseHandle(_mapping);
+        CloseHandle(_handle);
+        throw Error(std::string("Failed to map ").append(path));
+    }
+}
+
+MappedFile::~MappedFile(void)
+{
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mapping != NULL)
+        CloseHandle(_mapping);
+    CloseHandle(_handle);
+}
+#else
+MappedFile::MappedFile(const std::string& path)
+    : _data(nullptr), _size(0), _fd(-1)
+{
+    _fd = open(path.c_str(), O_RDONLY);
+    if (_fd < 0)
+        throw Error(std::string("Failed to open ").append(path));
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0)
+    {
+        close(_fd);
+        throw Error(std::string("Failed to open ").append(path));
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+    if (_size == 0)
+        return;
+
+    void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (p == MAP_FAILED)
+    {
+        close(_fd);
+        throw Error(std::string("Failed to map ").append(path));
+    }
+    madvise(p, _size, MADV_SEQUENTIAL);
+    _data = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile(void)
+{
+    if (_data != nullptr)
+        munmap(const_cast<char*>(_data), _size);
+    close(_fd);
+}
+#endif
+
+const char* MappedFile::data(void) const
+{
+    return _data;
+}
+
+std::size_t MappedFile::size(void) const
+{
+    return _size;
+}
+
+/*
+** STRUCTURAL SCANNER
+*/
+
+namespace simd
+{
+    // quote, separator and newline bits of 64 bytes
+    struct Masks
+    {
+        std::uint64_t quotes;
+        std::uint64_t seps;
+        std::uint64_t newlines;
+    };
+
+    typedef Masks (*Classifier)(const char*, char);
+
+    inline unsigned int trailingZeros(std::uint64_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(x);
+#else
+        unsigned int n = 0;
+        while (!(x & 1))
+        {
+            x >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+
+    inline unsigned int popCount(std::uint64_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        return static_cast<unsigned int>(std::bitset<64>(x).count());
+#endif
+    }
+
+    // bit i = XOR of bits 0..i, i.e. set while inside quotes
+    inline std::uint64_t prefixXor(std::uint64_t x)
+    {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+    Masks classifyScalar(const char* p, char sep)
+    {
+        Masks m = { 0, 0, 0 };
+        for (unsigned int i = 0; i < 64; i++)
+        {
+            m.quotes |= static_cast<std::uint64_t>(p[i] == '"') << i;
+            m.seps |= static_cast<std::uint64_t>(p[i] == sep) << i;
+            m.newlines |= static_cast<std::uint64_t>(p[i] == '\n') << i;
+        }
+        return m;
+    }
+
+#ifdef CSV_X86
+    CSV_TARGET("sse2")
+    Masks classifySse2(const char* p, char sep)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i comma = _mm_set1_epi8(sep);
+        const __m128i newline = _mm_set1_epi8('\n');
+        Masks m = { 0, 0, 0 };
+
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            m.quotes |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << (16 * i);
+            m.seps |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)))) << (16 * i);
+            m.newlines |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)))) << (16 * i);
+        }
+        return m;
+    }
+
+    CSV_TARGET("avx2")
+    Masks classifyAvx2(const char* p, char sep)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i comma = _mm256_set1_epi8(sep);
+        const __m256i newline = _mm256_set1_epi8('\n');
+        Masks m = { 0, 0, 0 };
+
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+            m.quotes |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))) << (32 * i);
+            m.seps |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)))) << (32 * i);
+            m.newlines |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)))) << (32 * i);
+        }
+        return m;
+    }
+
+    bool hasAvx2(void)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    // chosen once per process
+    Classifier classifier(void)
+    {
+        static const Classifier best = []() -> Classifier {
+#ifdef CSV_X86
+            if (hasAvx2())
+                return classifyAvx2;
+            return classifySse2;
+#else
+            return classifyScalar;
+#endif
+        }();
+        return best;
+    }
+}
+
+StructuralScanner::StructuralScanner(const char* begin, const char* end, char sep)
+    : _begin(begin), _end(end), _offset(0), _sep(sep), _structural(0), _newlines(0),
+    _quoted(0), _linesBefore(0), _done(begin >= end)
+{
+    if (!_done)
+        load();
+}
+
+void StructuralScanner::load(void)
+{
+    const char* block = _begin + _offset;
+    std::size_t left = _end - block;
+    simd::Masks m;
+
+    if (left >= 64)
+        m = simd::classifier()(block, _sep);
+    else
+    {
+        // last partial block, zero padded
+        char tail[64] = { 0 };
+        std::memcpy(tail, block, left);
+        m = simd::classifier()(tail, _sep);
+        std::uint64_t valid = (1ULL << left) - 1;
+        m.quotes &= valid;
+        m.seps &= valid;
+        m.newlines &= valid;
+    }
+
+    std::uint64_t inside = simd::prefixXor(m.quotes) ^ _quoted;
+    _quoted = static_cast<std::uint64_t>(0) - (inside >> 63);
+    _structural = (m.seps | m.newlines) & ~inside;
+    _newlines = m.newlines;
+}
+
+// next separator or newline outside quotes, or end
+const char* StructuralScanner::next(void)
+{
+    while (_structural == 0)
+    {
+        if (_done)
+            return _end;
+        _linesBefore += simd::popCount(_newlines);
+        _newlines = 0;
+        _offset += 64;
+        if (_offset >= static_cast<std::size_t>(_end - _begin))
+        {
+            _done = true;
+            return _end;
+        }
+        load();
+    }
+
+    unsigned int bit = simd::trailingZeros(_structural);
+    _structural &= _structural - 1;
+    return _begin + _offset + bit;
+}
+
+// newlines, quoted or not, in [begin, it); it is end or the last result of next()
+std::size_t StructuralScanner::newlinesBefore(const char* it) const
+{
+    if (_done)
+        return _linesBefore;
+    std::size_t bit = it - (_begin + _offset);
+    return _linesBefore + simd::popCount(_newlines & ((1ULL << bit) - 1));
+}
+
+/*
+** COLUMN
+*/
+
+Column::Column(const char* external)
+    : _external(external), _garbage(0) {}
+
+const char* Column::base(void) const
+{
+    return _external != nullptr ? _external : _bytes.data();
+}
+
+std::size_t Column::size(void) const
+{
+    return _cells.size();
+}
+
+void Column::reserve(std::size_t rows)
+{
+    _cells.reserve(rows);
+}
+
+Column::Cell Column::store(std::string_view value)
+{
+    Cell cell = { _bytes.size(), static_cast<std::uint32_t>(value.length()) };
+    _bytes.append(value.data(), value.length());
+    return cell;
+}
+
+// copy live cells into a fresh buffer, in row order
+void Column::repack(void)
+{
+    std::string bytes;
+    std::size_t live = 0;
+    const char* from = base();
+
+    for (auto it = _cells.begin(); it != _cells.end(); it++)
+        live += it->length;
+    bytes.reserve(live);
+    for (auto it = _cells.begin(); it != _cells.end(); it++)
+    {
+        std::uint64_t offset = bytes.size();
+        bytes.append(from + it->offset, it->length);
+        it->offset = offset;
+    }
+    _bytes.swap(bytes);
+    _external = nullptr;
+    _garbage = 0;
+}
+
+void Column::push(std::string_view value)
+{
+    if (_external != nullptr)
+        repack();
+    _cells.push_back(store(value));
+}
+
+// value must point into the borrowed buffer
+void Column::pushView(std::string_view value)
+{
+    Cell cell = { static_cast<std::uint64_t>(value.data() - _external), static_cast<std::uint32_t>(value.length()) };
+    _cells.push_back(cell);
+}
+
+// take over the cells of a column that borrows the same buffer
+void Column::append(const Column& other)
+{
+    if (_external == nullptr || other._external != _external)
+        throw Error("can't append columns over different buffers");
+    _cells.insert(_cells.end(), other._cells.begin(), other._cells.end());
+}
+
+void Column::insert(std::size_t pos, std::string_view value)
+{
+    if (_external != nullptr)
+        repack();
+    _cells.insert(_cells.begin() + pos, store(value));
+}
+
+void Column::assign(std::size_t pos, std::string_view value)
+{
+    if (_external != nullptr)
+        repack();
+
+    Cell& cell = _cells[pos];
+    if (value.length() <= cell.length)
+    {
+        // fits, overwrite in place
+        std::memcpy(&_bytes[cell.offset], value.data(), value.length());
+        _garbage += cell.length - value.length();
+        cell.length = static_cast<std::uint32_t>(value.length());
+    }
+    else
+    {
+        _garbage += cell.length;
+        cell = store(value);
+    }
+
+    if (_garbage > _bytes.size() / 2)
+        repack();
+}
+
+void Column::erase(std::size_t pos)
+{
+    if (_external == nullptr)
+        _garbage += _cells[pos].length;
+    _cells.erase(_cells.begin() + pos);
+}
+
+/*
+** SCHEMA
+*/
+
+Schema::Schema(const std::vector<std::string>& names)
+    : _names(names)
+{
+    _index.reserve(_names.size());
+    // first occurrence wins on duplicate names
+    for (unsigned int i = 0; i < _names.size(); i++)
+        _index.emplace(_names[i], i);
+}
+
+unsigned int Schema::size(void) const
+{
+    return _names.size();
+}
+
+const std::vector<std::string>& Schema::names(void) const
+{
+    return _names;
+}
+
+const std::string& Schema::name(unsigned int pos) const
+{
+    return _names[pos];
+}
+
+bool Schema::find(const std::string& name, unsigned int& pos) const
+{
+    auto it = _index.find(name);
+    if (it == _index.end())
+        return false;
+    pos = it->second;
+    return true;
+}
+
+Schema::Handle Schema::resolve(const std::string& name) const
+{
+    unsigned int pos;
+    if (!find(name, pos))
+        throw Error(std::string("unknown column ").append(name));
+    return Handle{ pos };
+}
+
+/*
+** ROW
+*/
+
+Row::Row(const std::vector<std::string>& header)
+    : _schema(std::make_shared<const Schema>(header)), _owner(nullptr), _index(0) {}
+
+Row::Row(const std::shared_ptr<const Schema>& schema)
+    : _schema(schema), _owner(nullptr), _index(0) {}
+
+Row::Row(const std::shared_ptr<const Schema>& schema, Parser* owner, unsigned int index)
+    : _schema(schema), _owner(owner), _index(index) {}
+
+Row::~Row(void) {}
+
+unsigned int Row::size(void) const
+{
+    if (_owner != nullptr)
+        return _owner->columnCount();
+    return _values.size();
+}
+
+void Row::push(const std::string& value)
+{
+    if (_owner != nullptr)
+        throw Error("can't push to a row owned by a parser");
+    _values.push_back(value);
+}
+
+bool Row::set(const std::string& key, const std::string& value)
+{
+    unsigned int pos;
+
+    if (!_schema->find(key, pos) || pos >= size())
+        return false;
+    set(Schema::Handle{ pos }, value);
+    return true;
+}
+
+void Row::set(Schema::Handle handle, const std::string& value)
+{
+    if (handle.index >= size())
+        throw Error("can't set this value (doesn't exist)");
+    if (_owner != nullptr)
+    {
+        _owner->_columns[handle.index].assign(_index, value);
+        _owner->noteSet(_index, handle.index, value);
+    }
+    else
+        _values[handle.index] = value;
+}
+
+const Schema& Row::schema(void) const
+{
+    return *_schema;
+}
+
+// no copy; valid until the value or its column changes
+std::string_view Row::view(unsigned int valuePosition) const
+{
+    if (_owner != nullptr)
+        return _owner->_columns[valuePosition][_index];
+    return _values[valuePosition];
+}
+
+const std::string Row::operator[](unsigned int valuePosition) const
+{
+    if (valuePosition < size())
+    {
+        if (_owner != nullptr)
+            return std::string(_owner->_columns[valuePosition][_index]);
+        return _values[valuePosition];
+    }
+    throw Error("can't return this value (doesn't exist)");
+}
+
+const std::string Row::operator[](const std::string& key) const
+{
+    unsigned int pos;
+
+    if (_schema->find(key, pos))
+        return (*this)[pos];
+
+    throw Error("can't return this value (doesn't exist)");
+}
+
+const std::string Row::operator[](Schema::Handle handle) const
+{
+    return (*this)[handle.index];
+}
+
+std::ostream& operator<<(std::ostream& os, const Row& row)
+{
+    for (unsigned int i = 0; i != row.size(); i++)
+        os << row[i] << " | ";
+
+    return os;
+}
+
+std::ofstream& operator<<(std::ofstream& os, const Row& row)
+{
+    for (unsigned int i = 0; i != row.size(); i++)
+    {
+        os << row[i];
+        if (i < row.size() - 1)
+            os << ",";
+    }
+    return os;
+}
+
+
+/*
+** EXTERNAL SORT
+**
+** Sorts a file that need not fit in memory. Records are streamed through
+** Parser::forEachRow, so with <file>.log applied, into a run that fits
+** the memory budget; a full run is sorted and spilled to a temporary
+** file, and the runs are merged through a loser tree, at most MAX_FAN_IN
+** at a time. Records come out as sync() writes them: the raw values
+** joined by the separator. Records with equal keys keep their file order.
+*/
+
+class ExternalSort
+{
+public:
+    typedef std::function<void(const std::vector<std::string_view>&)> Callback;
+
+    ExternalSort(const std::string&, const std::vector<std::string>&, std::size_t memory = 64 << 20, char sep = ',');
+    ~ExternalSort(void);
+    ExternalSort(const ExternalSort&) = delete;
+    ExternalSort& operator=(const ExternalSort&) = delete;
+
+public:
+    void setTempDirectory(const std::string&);
+    std::size_t forEachSorted(const Callback&);
+    std::size_t sort(std::ostream&);
+    std::size_t sort(const std::string&);
+    std::size_t runCount(void) const;
+
+private:
+    static const std::size_t MAX_FAN_IN = 64;
+    class RunReader;
+
+    void collect(const RecordView&);
+    void spill(void);
+    void sortRun(void);
+    std::string tempName(void);
+    std::size_t merge(std::vector<std::string>&, const Callback&);
+    static void encode(std::string&, const std::vector<std::string_view>&);
+    static void join(std::string&, const std::vector<std::string_view>&, char);
+
+private:
+    std::string _file;
+    std::vector<std::string> _keyNames;
+    std::size_t _memory;
+    const char _sep;
+    std::filesystem::path _tempDir;
+    std::vector<std::string> _header;
+    std::vector<unsigned int> _keys;              // key columns, most significant first
+    std::string _arena;                           // the records of the current run, encoded
+    std::vector<std::size_t> _records;            // where each record starts in _arena
+    std::vector<std::string_view> _recordKeys;    // _keys.size() views per record, into _arena
+    std::vector<std::string> _runs;               // run files not removed yet, oldest first
+    std::size_t _spilled;
+    std::size_t _temps;                           // temporary files named so far
+};
+
+/*
+** Reads a spilled run back one record at a time through a buffer of its
+** share of the memory budget (grown if a single record is larger).
+*/
+class ExternalSort::RunReader
+{
+public:
+    RunReader(const std::string& path, std::size_t buffer, unsigned int fields)
+        : _in(path.c_str(), std::ios::binary), _buffer(std::max<std::size_t>(buffer, 4096)),
+          _begin(0), _end(0), _values(fields)
+    {
+        if (!_in.is_open())
+            throw Error(std::string("Failed to open ").append(path));
+    }
+
+    // the current record, valid until next()
+    const std::vector<std::string_view>& values(void) const { return _values; }
+
+    // false once the run is exhausted
+    bool next(void)
+    {
+        std::size_t size = 0;
+        while (!decode(size))
+        {
+            if (!fill(size))
+            {
+                if (_begin != _end)
+                    throw Error("corrupted sort run !");
+                return false;
+            }
+        }
+        _begin += size;
+        return true;
+    }
+
+private:
+    // decode the record at _begin; needed is how many bytes it takes, or at least more than what is there
+    bool decode(std::size_t& needed)
+    {
+        const char* data = _buffer.data();
+        std::size_t at = _begin;
+        for (std::string_view& value : _values)
+        {
+            std::uint32_t length;
+            if (_end - at < sizeof(length))
+            {
+                needed = at - _begin + sizeof(length);
+                return false;
+            }
+            std::memcpy(&length, data + at, sizeof(length));
+            at += sizeof(length);
+            if (_end - at < length)
+            {
+                needed = at - _begin + length;
+                return false;
+            }
+            value = std::string_view(data + at, length);
+            at += length;
+        }
+        needed = at - _begin;
+        return true;
+    }
+
+    // keep the partial record, make room for needed bytes of it and read more
+    bool fill(std::size_t needed)
+    {
+        if (!_in)
+            return false;
+        std::size_t kept = _end - _begin;
+        std::memmove(_buffer.data(), _buffer.data() + _begin, kept);
+        _begin = 0;
+        _end = kept;
+        if (needed > _buffer.size())
+            _buffer.resize(std::max(needed, _buffer.size() * 2));
+        _in.read(_buffer.data() + _end, _buffer.size() - _end);
+        _end += static_cast<std::size_t>(_in.gcount());
+        CSV_COUNT(BYTES_READ, _in.gcount());
+        return _end > kept;
+    }
+
+private:
+    std::ifstream _in;
+    std::vector<char> _buffer;
+    std::size_t _begin;
+    std::size_t _end;
+    std::vector<std::string_view> _values;
+};
+
+/*
+** @param file the CSV file to sort
+** @param keys the columns to sort by, most significant first, e.g. {"title", "courseId"}
+** @param memory the budget for one run, in bytes
+*/
+ExternalSort::ExternalSort(const std::string& file, const std::vector<std::string>& keys, std::size_t memory, char sep)
+    : _file(file), _keyNames(keys), _memory(std::max<std::size_t>(memory, 1 << 16)), _sep(sep),
+      _tempDir(std::filesystem::temp_directory_path()), _spilled(0), _temps(0)
+{
+    if (keys.empty())
+        throw Error("no sort key");
+}
+
+ExternalSort::~ExternalSort(void)
+{
+    std::error_code ec;
+    for (const std::string& run : _runs)
+        std::filesystem::remove(run, ec);
+}
+
+// where the runs are spilled, the system temporary directory by default
+void ExternalSort::setTempDirectory(const std::string& directory)
+{
+    _tempDir = directory;
+}
+
+// the number of runs spilled by the last sort, 0 if it fit in memory
+std::size_t ExternalSort::runCount(void) const
+{
+    return _spilled;
+}
+
+/*
+** Sort the file and hand every record, in order, to
+** callback(const std::vector<std::string_view>&). The values are only
+** valid during the callback.
+**
+** @return the number of records
+*/
+std::size_t ExternalSort::forEachSorted(const Callback& callback)
+{
+    _header.clear();
+    _keys.clear();
+    _arena.clear();
+    _records.clear();
+    _recordKeys.clear();
+    _spilled = 0;
+
+    Parser::forEachRow(_file, [this](const RecordView& record) { collect(record); }, _sep);
+
+    if (_runs.empty())
+    {
+        // everything fit, no merge needed
+        sortRun();
+        std::vector<std::string_view> values(_header.size());
+        for (std::size_t record : _records)
+        {
+            const char* at = _arena.data() + record;
+            for (std::string_view& value : values)
+            {
+                std::uint32_t length;
+                std::memcpy(&length, at, sizeof(length));
+                value = std::string_view(at + sizeof(length), length);
+                at += sizeof(length) + length;
+            }
+            callback(values);
+        }
+        std::size_t count = _records.size();
+        _arena.clear();
+        _records.clear();
+        _recordKeys.clear();
+        return count;
+    }
+
+    if (!_records.empty())
+        spill();
+    _arena = std::string();
+    std::vector<std::string> runs = _runs;
+    return merge(runs, callback);
+}
+
+/*
+** Write the header and the sorted records to out, in large blocks
+**
+** @return the number of records
+*/
+std::size_t ExternalSort::sort(std::ostream& out)
+{
+    static const std::size_t BLOCK_SIZE = 1 << 20;
+    std::string block;
+    block.reserve(BLOCK_SIZE + 4096);
+    bool started = false;
+
+    std::size_t count = forEachSorted([&](const std::vector<std::string_view>& values) {
+        if (!started)
+        {
+            std::vector<std::string_view> names(_header.begin(), _header.end());
+            join(block, names, _sep);
+            started = true;
+        }
+        join(block, values, _sep);
+        if (block.size() >= BLOCK_SIZE)
+        {
+            out.write(block.data(), block.size());
+            block.clear();
+        }
+    });
+
+    // no records: the header is still the first non-empty line
+    if (!started)
+    {
+        std::ifstream in(_file.c_str(), std::ios::binary);
+        for (std::string line; std::getline(in, line);)
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+            {
+                block.append(line).append(1, '\n');
+                break;
+            }
+        }
+    }
+    out.write(block.data(), block.size());
+    return count;
+}
+
+/*
+** Sort into a file, which is replaced only once the sort succeeded
+**
+** @return the number of records
+*/
+std::size_t ExternalSort::sort(const std::string& output)
+{
+    std::string temp = output + ".tmp";
+    std::size_t count;
+    {
+        std::ofstream f(temp, std::ios::out | std::ios::trunc | std::ios::binary);
+        count = sort(f);
+        f.close();
+        if (!f)
+            throw Error(std::string("Failed to write ").append(temp));
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp, output, ec);
+    if (ec)
+        throw Error(std::string("Failed to replace ").append(output));
+    return count;
+}
+
+// add one record to the current run, spilling the run first if the record does not fit
+void ExternalSort::collect(const RecordView& record)
+{
+    if (_header.empty())
+    {
+        _header = record.schema().names();
+        for (const std::string& name : _keyNames)
+        {
+            unsigned int pos;
+            if (!record.schema().find(name, pos))
+                throw Error(std::string("no column ").append(name).append(" to sort by"));
+            _keys.push_back(pos);
+        }
+    }
+
+    std::size_t size = 0;
+    for (std::string_view value : record.values())
+        size += sizeof(std::uint32_t) + value.size();
+    // the offset and key views, plus what sortRun needs for it
+    std::size_t overhead = 2 * sizeof(std::size_t) + 2 * sizeof(std::uint32_t) + _keys.size() * sizeof(std::string_view);
+
+    // the key views point into _arena, so it must never reallocate while it holds a run
+    if (_arena.size() + size > _arena.capacity() || (_arena.size() + size) + (_records.size() + 1) * overhead > _memory)
+    {
+        if (!_records.empty())
+            spill();
+        if (size > _arena.capacity())
+            _arena.reserve(std::max(size, _memory / 2));
+    }
+
+    std::size_t at = _arena.size();
+    encode(_arena, record.values());
+    _records.push_back(at);
+    for (unsigned int key : _keys)
+    {
+        const char* value = _arena.data() + at;
+        for (unsigned int i = 0; i < key; i++)
+        {
+            std::uint32_t length;
+            std::memcpy(&length, value, sizeof(length));
+            value += sizeof(length) + length;
+        }
+        _recordKeys.emplace_back(value + sizeof(std::uint32_t), record.values()[key].size());
+    }
+}
+
+// sort the records in memory by their keys; stable, so ties keep file order
+void ExternalSort::sortRun(void)
+{
+    const std::size_t keys = _keys.size();
+    std::vector<std::uint32_t> order(_records.size());
+    for (std::uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    const std::string_view* recordKeys = _recordKeys.data();
+    std::stable_sort(order.begin(), order.end(), [recordKeys, keys](std::uint32_t a, std::uint32_t b) {
+        CSV_COUNT(SORT_COMPARISONS, 1);
+        for (std::size_t k = 0; k < keys; k++)
+        {
+            int c = recordKeys[a * keys + k].compare(recordKeys[b * keys + k]);
+            if (c != 0)
+                return c < 0;
+        }
+        return false;
+    });
+
+    std::vector<std::size_t> sorted(order.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+        sorted[i] = _records[order[i]];
+    _records.swap(sorted);
+}
+
+// write the current run, sorted, to a temporary file and start a new one
+void ExternalSort::spill(void)
+{
+    sortRun();
+
+    static const std::size_t BLOCK_SIZE = 1 << 20;
+    std::string name = tempName();
+    _runs.push_back(name);
+    std::ofstream f(name, std::ios::out | std::ios::trunc | std::ios::binary);
+    std::string block;
+    block.reserve(BLOCK_SIZE + 4096);
+    const unsigned int fields = static_cast<unsigned int>(_header.size());
+    for (std::size_t record : _records)
+    {
+        const char* at = _arena.data() + record;
+        const char* end = at;
+        for (unsigned int i = 0; i < fields; i++)
+        {
+            std::uint32_t length;
+            std::memcpy(&length, end, sizeof(length));
+            end += sizeof(length) + length;
+        }
+        block.append(at, end - at);
+        if (block.size() >= BLOCK_SIZE)
+        {
+            f.write(block.data(), block.size());
+            block.clear();
+        }
+    }
+    f.write(block.data(), block.size());
+    f.close();
+    if (!f)
+        throw Error(std::string("Failed to write ").append(name));
+
+    _spilled++;
+    _arena.clear();
+    _records.clear();
+    _recordKeys.clear();
+}
+
+std::string ExternalSort::tempName(void)
+{
+    std::string name = "csvsort-" + std::to_string(reinterpret_cast<std::uintptr_t>(this)) + "-"
+        + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-"
+        + std::to_string(_temps++) + ".run";
+    return (_tempDir / name).string();
+}
+
+/*
+** K-way merge of sorted runs through a loser tree: each inner node holds
+** the run that lost the match played there and node 0 the overall
+** winner, so taking a record costs one path of log2(k) comparisons.
+** With more than MAX_FAN_IN runs, the oldest are merged into a new run
+** first. The run files are removed as they are consumed.
+**
+** @return the number of records
+*/
+std::size_t ExternalSort::merge(std::vector<std::string>& runs, const Callback& callback)
+{
+    const unsigned int fields = static_cast<unsigned int>(_header.size());
+
+    // each pass merges neighbouring groups, so the runs stay in file order
+    while (runs.size() > MAX_FAN_IN)
+    {
+        std::vector<std::string> merged;
+        for (std::size_t first = 0; first < runs.size(); first += MAX_FAN_IN)
+        {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(first + MAX_FAN_IN, runs.size()));
+
+            static const std::size_t BLOCK_SIZE = 1 << 20;
+            std::string name = tempName();
+            _runs.push_back(name);
+            std::ofstream f(name, std::ios::out | std::ios::trunc | std::ios::binary);
+            std::string block;
+            merge(group, [&](const std::vector<std::string_view>& values) {
+                encode(block, values);
+                if (block.size() >= BLOCK_SIZE)
+                {
+                    f.write(block.data(), block.size());
+                    block.clear();
+                }
+            });
+            f.write(block.data(), block.size());
+            f.close();
+            if (!f)
+                throw Error(std::string("Failed to write ").append(name));
+            merged.push_back(name);
+        }
+        runs.swap(merged);
+    }
+
+    const std::size_t k = runs.size();
+    std::vector<std::unique_ptr<RunReader> > readers;
+    std::vector<bool> live(k);
+    for (std::size_t i = 0; i < k; i++)
+    {
+        readers.emplace_back(new RunReader(runs[i], _memory / (k + 1), fields));
+        live[i] = readers[i]->next();
+    }
+
+    // a beats b if its record comes first; exhausted runs lose, ties go to the older run
+    const std::vector<unsigned int>& keys = _keys;
+    auto beats = [&](std::size_t a, std::size_t b) {
+        if (!live[a] || !live[b])
+            return live[a] && !live[b];
+        CSV_COUNT(SORT_COMPARISONS, 1);
+        const std::vector<std::string_view>& x = readers[a]->values();
+        const std::vector<std::string_view>& y = readers[b]->values();
+        for (unsigned int key : keys)
+        {
+            int c = x[key].compare(y[key]);
+            if (c != 0)
+                return c < 0;
+        }
+        return a < b;
+    };
+
+    // k stands for a run that beats every other, so replaying each leaf
+    // once leaves a real match result in every node
+    const std::size_t NONE = k;
+    std::vector<std::size_t> tree(k, NONE);
+    auto replay = [&](std::size_t winner) {
+        for (std::size_t node = (winner + k) / 2; node > 0; node /= 2)
+        {
+            if (tree[node] == NONE || (winner != NONE && beats(tree[node], winner)))
+                std::swap(tree[node], winner);
+        }
+        tree[0] = winner;
+    };
+    for (std::size_t i = 0; i < k; i++)
+        replay(i);
+
+    std::size_t count = 0;
+    while (k > 0 && live[tree[0]])
+    {
+        std::size_t winner = tree[0];
+        callback(readers[winner]->values());
+        count++;
+        live[winner] = readers[winner]->next();
+        replay(winner);
+    }
+
+    readers.clear();
+    std::error_code ec;
+    for (const std::string& run : runs)
+    {
+        std::filesystem::remove(run, ec);
+        _runs.erase(std::find(_runs.begin(), _runs.end(), run));
+    }
+    return count;
+}
+
+// length prefixed values, the run file format
+void ExternalSort::encode(std::string& out, const std::vector<std::string_view>& values)
+{
+    for (std::string_view value : values)
+    {
+        std::uint32_t length = static_cast<std::uint32_t>(value.size());
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(value.data(), value.size());
+    }
+}
+
+// one output line, as sync() writes it
+void ExternalSort::join(std::string& out, const std::vector<std::string_view>& values, char sep)
+{
+    for (std::size_t i = 0; i < values.size(); i++)
+    {
+        out.append(values[i].data(), values[i].size());
+        out.append(1, i < values.size() - 1 ? sep : '\n');
+    }
+}
+
+//============================================================================
+// Global definitions visible to all methods and classes
+//============================================================================
+
+// forward declarations
+double strToDouble(std::string_view str, char ch);
+
+// define a structure to hold course information
+// text fields are views into the StringPool of the catalog holding the course
+struct Course {
+    std::string_view courseId; // unique identifier
+    std::string_view title;
+    std::string_view prerequisites;
+    double amount;
+    uint32_t node; // vertex in Catalog::prereqs, travels with the course when it is sorted
+    Course() {
+        amount = 0.0;
+        node = 0;
+    }
+};
+
+// the columns of a course file, bound to Course by header name
+struct CourseColumns {
+    typedef Course Record;
+
+    static constexpr auto fields() {
+        return std::make_tuple(bindField("courseId", &Course::courseId), bindField("title", &Course::title),
+            bindField("prerequisites", &Course::prerequisites));
+    }
+};
+
+/**
+ * 64-bit FNV-1a hash; stable across runs and platforms
+ */
+uint64_t hashKey(std::string_view key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// open-addressing hash index from courseId to a position in a course vector
+class CourseIndex {
+public:
+    CourseIndex();
+    void build(const vector<Course>& courses);
+    void reorder(const vector<uint32_t>& remap);
+    const Course* find(const vector<Course>& courses, std::string_view courseId) const;
+    size_t size() const;
+
+private:
+    friend class Snapshot;
+
+    // flat slots probed linearly, so most lookups touch one cache line
+    struct Slot {
+        uint32_t tag;      // high hash bits, skips most string compares
+        uint32_t position; // course position + 1, 0 marks an empty slot
+    };
+    vector<Slot> slots;
+    size_t mask;
+    size_t count;
+};
+
+CourseIndex::CourseIndex() {
+    mask = 0;
+    count = 0;
+}
+
+/**
+ * Rebuild the index over the given courses. Keeps the first course
+ * when an id repeats, like the old linear search did.
+ *
+ * @param courses the courses to index, positions must stay stable
+ */
+void CourseIndex::build(const vector<Course>& courses) {
+    size_t capacity = 16;
+
+    // keep the load factor at or under 1/2
+    while (capacity < courses.size() * 2) {
+        capacity <<= 1;
+    }
+    slots.assign(capacity, Slot{ 0, 0 });
+    mask = capacity - 1;
+    count = 0;
+
+    for (size_t i = 0; i < courses.size(); ++i) {
+        uint64_t hash = hashKey(courses[i].courseId);
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        size_t idx = hash & mask;
+
+        while (slots[idx].position != 0) {
+            const Slot& slot = slots[idx];
+            if (slot.tag == tag && courses[slot.position - 1].courseId == courses[i].courseId) {
+                break;
+            }
+            idx = (idx + 1) & mask;
+        }
+        if (slots[idx].position == 0) {
+            slots[idx] = Slot{ tag, static_cast<uint32_t>(i + 1) };
+            ++count;
+        }
+    }
+}
+
+/**
+ * Follow a reorder of the courses without hashing again: the slots stay,
+ * only the positions they hold are renamed. With repeated ids the slot
+ * keeps the course it had, not the first one in the new order.
+ *
+ * @param remap old position -> new position
+ */
+void CourseIndex::reorder(const vector<uint32_t>& remap) {
+    for (Slot& slot : slots) {
+        if (slot.position != 0) {
+            slot.position = remap[slot.position - 1] + 1;
+        }
+    }
+}
+
+/**
+ * Look up a course by id
+ *
+ * @param courses the courses the index was built over
+ * @param courseId the id to look for
+ * @return the course, or nullptr when it is not indexed
+ */
+const Course* CourseIndex::find(const vector<Course>& courses, std::string_view courseId) const {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    uint64_t hash = hashKey(courseId);
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    size_t probes = 0;
+    const Course* found = nullptr;
+
+    for (size_t idx = hash & mask; slots[idx].position != 0; idx = (idx + 1) & mask) {
+        const Slot& slot = slots[idx];
+        ++probes;
+        if (slot.tag == tag && courses[slot.position - 1].courseId == courseId) {
+            found = &courses[slot.position - 1];
+            break;
+        }
+    }
+    CSV_COUNT(SEARCH_LOOKUPS, 1);
+    CSV_COUNT(SEARCH_PROBES, probes);
+    return found;
+}
+
+size_t CourseIndex::size() const {
+    return count;
+}
+
+// arena holding the text of one catalog generation; courses keep views
+// into it, and dropping the pool frees every string at once
+class StringPool {
+public:
+    StringPool();
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view store(std::string_view text);
+    std::string_view intern(std::string_view text);
+    void share(std::string_view text);
+    size_t bytes() const;
+
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    std::string_view* lookup(std::string_view text, uint64_t hash);
+    void grow();
+
+    vector<std::unique_ptr<char[]>> blocks;
+    char* cursor;           // free space left in the current block
+    size_t left;
+    size_t used;
+    vector<std::string_view> slots; // interned strings, open addressing
+    size_t interned;
+};
+
+StringPool::StringPool() {
+    cursor = nullptr;
+    left = 0;
+    used = 0;
+    interned = 0;
+}
+
+/**
+ * Copy text into the pool
+ *
+ * @return a view of the copy, valid as long as the pool
+ */
+std::string_view StringPool::store(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    used += text.size();
+
+    // large strings get a block of their own, the current one stays open
+    if (text.size() > BLOCK_SIZE / 4) {
+        blocks.emplace_back(new char[text.size()]);
+        std::memcpy(blocks.back().get(), text.data(), text.size());
+        return std::string_view(blocks.back().get(), text.size());
+    }
+    if (text.size() > left) {
+        blocks.emplace_back(new char[BLOCK_SIZE]);
+        cursor = blocks.back().get();
+        left = BLOCK_SIZE;
+    }
+    std::memcpy(cursor, text.data(), text.size());
+    std::string_view copy(cursor, text.size());
+    cursor += text.size();
+    left -= text.size();
+    return copy;
+}
+
+/**
+ * Like store, but equal strings are kept once, e.g. a course id and its
+ * mentions in prerequisite lists
+ */
+std::string_view StringPool::intern(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    std::string_view* slot = lookup(text, hashKey(text));
+    if (slot->data() != nullptr) {
+        return *slot;
+    }
+    std::string_view copy = store(text);
+    *slot = copy;
+    ++interned;
+    grow();
+    return copy;
+}
+
+/**
+ * Make text, already in the pool, the copy that intern hands out
+ * for equal strings
+ */
+void StringPool::share(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+    std::string_view* slot = lookup(text, hashKey(text));
+    if (slot->data() == nullptr) {
+        *slot = text;
+        ++interned;
+        grow();
+    }
+}
+
+/**
+ * Number of text bytes held, not counting block slack
+ */
+size_t StringPool::bytes() const {
+    return used;
+}
+
+// slot holding text, or the empty slot where it belongs
+std::string_view* StringPool::lookup(std::string_view text, uint64_t hash) {
+    if (slots.empty()) {
+        slots.resize(64);
+    }
+    size_t mask = slots.size() - 1;
+    size_t idx = hash & mask;
+    while (slots[idx].data() != nullptr && slots[idx] != text) {
+        idx = (idx + 1) & mask;
+    }
+    return &slots[idx];
+}
+
+// keep the intern table at or under half full
+void StringPool::grow() {
+    if (interned * 2 <= slots.size()) {
+        return;
+    }
+    vector<std::string_view> old(slots.size() * 2);
+    old.swap(slots);
+    for (std::string_view text : old) {
+        if (text.data() != nullptr) {
+            *lookup(text, hashKey(text)) = text;
+        }
+    }
+}
+
+// sort engine tuning
+const ptrdiff_t INSERTION_SORT_CUTOFF = 16; // ranges this small are insertion sorted
+const ptrdiff_t NINTHER_THRESHOLD = 128;    // ranges this large pick a ninther pivot
+const ptrdiff_t PARALLEL_GRAIN = 1 << 14;   // ranges this large may go to another thread
+
+/**
+ * Insertion sort, fast on the small ranges introsort leaves behind
+ */
+template<typename It, typename Compare>
+void insertionSort(It first, It last, Compare comp) {
+    if (first == last) {
+        return;
+    }
+    for (It i = first + 1; i != last; ++i) {
+        auto value = std::move(*i);
+        It j = i;
+        for (; j != first && comp(value, *(j - 1)); --j) {
+            *j = std::move(*(j - 1));
+        }
+        *j = std::move(value);
+    }
+}
+
+/**
+ * Position of the median of *a, *b and *c
+ */
+template<typename It, typename Compare>
+It medianOfThree(It a, It b, It c, Compare comp) {
+    if (comp(*a, *b)) {
+        return comp(*b, *c) ? b : (comp(*a, *c) ? c : a);
+    }
+    return comp(*a, *c) ? a : (comp(*b, *c) ? c : b);
+}
+
+/**
+ * Move a median-of-three (or for large ranges a ninther) pivot to first,
+ * then partition [first + 1, last) around it. The pivot candidates act as
+ * sentinels, so the inner loops need no bounds checks.
+ *
+ * @return the split point: nothing before it is greater than the pivot,
+ *         nothing from it on is less
+ */
+template<typename It, typename Compare>
+It partitionRange(It first, It last, Compare comp) {
+    ptrdiff_t n = last - first;
+    It mid = first + n / 2;
+    It pivot;
+
+    if (n > NINTHER_THRESHOLD) {
+        ptrdiff_t step = n / 8;
+        pivot = medianOfThree(medianOfThree(first + 1, first + 1 + step, first + 1 + 2 * step, comp),
+            medianOfThree(mid - step, mid, mid + step, comp),
+            medianOfThree(last - 1 - 2 * step, last - 1 - step, last - 1, comp), comp);
+    }
+    else {
+        pivot = medianOfThree(first + 1, mid, last - 1, comp);
+    }
+    std::iter_swap(first, pivot);
+    CSV_COUNT(SORT_SWAPS, 1);
+
+    It low = first + 1;
+    It high = last;
+    while (true) {
+        while (comp(*low, *first)) {
+            ++low;
+        }
+        --high;
+        while (comp(*first, *high)) {
+            --high;
+        }
+        if (!(low < high)) {
+            return low;
+        }
+        std::iter_swap(low, high);
+        CSV_COUNT(SORT_SWAPS, 1);
+        ++low;
+    }
+}
+
+/**
+ * Introsort worker: quicksort that loops on the larger side and recurses
+ * (or forks onto the pool) on the smaller one, so the stack stays
+ * O(log n). Past the depth limit it switches to heapsort.
+ */
+template<typename It, typename Compare>
+void introSortLoop(It first, It last, int depth, Compare comp, WorkerPool* pool) {
+    while (last - first > INSERTION_SORT_CUTOFF) {
+        if (depth == 0) {
+            std::make_heap(first, last, comp);
+            std::sort_heap(first, last, comp);
+            return;
+        }
+        --depth;
+
+        It cut = partitionRange(first, last, comp);
+        It lo = first;
+        It hi = cut;
+        if (cut - first < last - cut) {
+            first = cut;
+        }
+        else {
+            lo = cut;
+            hi = last;
+            last = cut;
+        }
+
+        if (pool != nullptr && hi - lo >= PARALLEL_GRAIN) {
+            pool->submit([lo, hi, depth, comp, pool]() {
+                introSortLoop(lo, hi, depth, comp, pool);
+            });
+        }
+        else {
+            introSortLoop(lo, hi, depth, comp, pool);
+        }
+    }
+    insertionSort(first, last, comp);
+}
+
+/**
+ * introSort body; introSort picks the comparator
+ */
+template<typename It, typename Compare>
+void introSortRun(It first, It last, Compare comp, unsigned int threads) {
+    ptrdiff_t n = last - first;
+
+    int depth = 0;
+    for (ptrdiff_t i = n; i > 1; i >>= 1) {
+        depth += 2;
+    }
+
+    if (threads == 1 || n < 2 * PARALLEL_GRAIN) {
+        introSortLoop(first, last, depth, comp, static_cast<WorkerPool*>(nullptr));
+        return;
+    }
+
+    WorkerPool pool(threads);
+    pool.submit([first, last, depth, comp, &pool]() {
+        introSortLoop(first, last, depth, comp, &pool);
+    });
+    pool.wait();
+}
+
+/**
+ * Sort [first, last) by comp
+ * Average performance: O(n log(n))
+ * Worst case performance: O(n log(n))
+ *
+ * @param threads 1 sorts on the calling thread, 0 uses every core
+ */
+template<typename It, typename Compare>
+void introSort(It first, It last, Compare comp, unsigned int threads = 1) {
+    ptrdiff_t n = last - first;
+    if (n < 2) {
+        return;
+    }
+
+#if CSV_METRICS
+    // a separate instantiation, so uncounted sorts pay nothing per comparison
+    if (Metrics::enabled()) {
+        auto counted = [comp](const auto& a, const auto& b) {
+            Metrics::add(Metrics::SORT_COMPARISONS);
+            return comp(a, b);
+        };
+        introSortRun(first, last, counted, threads);
+        return;
+    }
+#endif
+    introSortRun(first, last, comp, threads);
+}
+
+// first 8 bytes of a sort key and the course it belongs to
+struct SortKey {
+    uint64_t prefix;   // big-endian, so integer order is byte order
+    uint32_t position;
+};
+
+/**
+ * Pack up to the first 8 bytes of key, zero padded, big-endian
+ */
+uint64_t keyPrefix(std::string_view key) {
+    uint64_t prefix = 0;
+    size_t n = std::min<size_t>(key.size(), 8);
+    for (size_t i = 0; i < n; ++i) {
+        prefix |= static_cast<uint64_t>(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+/**
+ * Order of the courses by one key, without moving a single course.
+ * Sorts compact (prefix, position) pairs; only pairs with equal
+ * prefixes look at the full strings. Equal keys keep their positions
+ * in order.
+ *
+ * @param courses the courses to order
+ * @param key the member to sort on, e.g. &Course::title
+ * @param threads 1 sorts on the calling thread, 0 uses every core
+ * @return positions of the courses in key order
+ */
+vector<uint32_t> sortedOrder(const vector<Course>& courses, std::string_view Course::* key, unsigned int threads = 1) {
+    vector<SortKey> keys(courses.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i].prefix = keyPrefix(courses[i].*key);
+        keys[i].position = static_cast<uint32_t>(i);
+    }
+
+    introSort(keys.begin(), keys.end(), [&courses, key](const SortKey& a, const SortKey& b) {
+        if (a.prefix != b.prefix) {
+            return a.prefix < b.prefix;
+        }
+        int order = (courses[a.position].*key).compare(courses[b.position].*key);
+        return order != 0 ? order < 0 : a.position < b.position;
+    }, threads);
+
+    vector<uint32_t> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        order[i] = keys[i].position;
+    }
+    return order;
+}
+
+/**
+ * Rearrange courses so that courses[i] becomes the old courses[order[i]].
+ * Follows the permutation's cycles, moving every course exactly once.
+ */
+void applyPermutation(vector<Course>& courses, const vector<uint32_t>& order) {
+    vector<bool> placed(courses.size(), false);
+
+    for (size_t start = 0; start < courses.size(); ++start) {
+        if (placed[start] || order[start] == start) {
+            continue;
+        }
+
+        Course held = std::move(courses[start]);
+        size_t i = start;
+        while (order[i] != start) {
+            courses[i] = std::move(courses[order[i]]);
+            placed[i] = true;
+            i = order[i];
+        }
+        courses[i] = std::move(held);
+        placed[i] = true;
+    }
+}
+
+/**
+ * Sort courses by one key through sortedOrder, then move them into
+ * place once
+ *
+ * @param threads 1 sorts on the calling thread, 0 uses every core
+ */
+void keySort(vector<Course>& courses, std::string_view Course::* key, unsigned int threads = 1) {
+    CSV_SCOPE(KEY_SORT);
+    applyPermutation(courses, sortedOrder(courses, key, threads));
+}
+
+// a slice of course positions handed out by SortedIndex
+struct PositionRange {
+    const uint32_t* first;
+    const uint32_t* last;
+
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
+// course positions ordered by one key, for prefix and range queries
+class SortedIndex {
+public:
+    typedef std::string_view Course::* Key;
+
+    SortedIndex(Key key);
+    void build(const vector<Course>& courses);
+    PositionRange range(const vector<Course>& courses, std::string_view low, std::string_view high) const;
+    PositionRange prefix(const vector<Course>& courses, std::string_view prefix) const;
+    void patch(const vector<Course>& courses, const vector<uint32_t>& remap, vector<uint32_t> touched);
+    void reorder(const vector<Course>& courses, const vector<uint32_t>& remap);
+
+private:
+    friend class Snapshot;
+    Key key;
+    vector<uint32_t> order;
+};
+
+SortedIndex::SortedIndex(Key key) {
+    this->key = key;
+}
+
+/**
+ * Rebuild the index; the course vector itself is left untouched
+ *
+ * @param courses the courses to index, positions must stay stable
+ */
+void SortedIndex::build(const vector<Course>& courses) {
+    order = sortedOrder(courses, key);
+}
+
+/**
+ * Follow a reorder of the courses, e.g. a sort: the keys keep their
+ * order, so only the positions are renamed. Runs of equal keys are put
+ * back in position order, the only part a permutation can disturb.
+ *
+ * @param courses the courses after the reorder
+ * @param remap old position -> new position
+ */
+void SortedIndex::reorder(const vector<Course>& courses, const vector<uint32_t>& remap) {
+    for (uint32_t& pos : order) {
+        pos = remap[pos];
+    }
+
+    size_t start = 0;
+    for (size_t i = 1; i <= order.size(); ++i) {
+        if (i == order.size() || courses[order[i]].*key != courses[order[start]].*key) {
+            if (i - start > 1) {
+                introSort(order.begin() + start, order.begin() + i, std::less<uint32_t>());
+            }
+            start = i;
+        }
+    }
+}
+
+/**
+ * Bring the index up to date after a few courses changed, without
+ * sorting everything again: the untouched entries keep their order,
+ * only the touched ones are sorted and merged in.
+ * Performance: O(n + k log k) for k touched courses
+ *
+ * @param courses the courses after the change
+ * @param remap old position -> new position, UINT32_MAX if removed;
+ *              empty if no course moved
+ * @param touched new positions of courses that were added or whose key changed
+ */
+void SortedIndex::patch(const vector<Course>& courses, const vector<uint32_t>& remap, vector<uint32_t> touched) {
+    vector<bool> moved(courses.size(), false);
+    for (uint32_t pos : touched) {
+        moved[pos] = true;
+    }
+
+    // remap only ever moves courses up, so the kept entries stay sorted
+    vector<uint32_t> kept;
+    kept.reserve(courses.size());
+    for (uint32_t old : order) {
+        uint32_t pos = remap.empty() ? old : remap[old];
+        if (pos != UINT32_MAX && !moved[pos]) {
+            kept.push_back(pos);
+        }
+    }
+
+    Key key = this->key;
+    auto less = [&courses, key](uint32_t a, uint32_t b) {
+        int order = (courses[a].*key).compare(courses[b].*key);
+        return order != 0 ? order < 0 : a < b;
+    };
+    introSort(touched.begin(), touched.end(), less);
+
+    order.clear();
+    order.reserve(kept.size() + touched.size());
+    std::merge(kept.begin(), kept.end(), touched.begin(), touched.end(), std::back_inserter(order), less);
+}
+
+/**
+ * All courses whose key lies in [low, high), in key order
+ * Performance: O(log n) to find the slice
+ */
+PositionRange SortedIndex::range(const vector<Course>& courses, std::string_view low, std::string_view high) const {
+    Key k = key;
+    const uint32_t* first = order.data();
+    const uint32_t* last = order.data() + order.size();
+
+    first = std::lower_bound(first, last, low, [&courses, k](uint32_t pos, std::string_view value) {
+        return std::string_view(courses[pos].*k) < value;
+    });
+    last = std::lower_bound(first, last, high, [&courses, k](uint32_t pos, std::string_view value) {
+        return std::string_view(courses[pos].*k) < value;
+    });
+    return PositionRange{ first, last };
+}
+
+/**
+ * All courses whose key starts with prefix, in key order
+ * Performance: O(log n) to find the slice
+ */
+PositionRange SortedIndex::prefix(const vector<Course>& courses, std::string_view prefix) const {
+    Key k = key;
+    const uint32_t* first = order.data();
+    const uint32_t* last = order.data() + order.size();
+
+    first = std::lower_bound(first, last, prefix, [&courses, k](uint32_t pos, std::string_view value) {
+        return std::string_view(courses[pos].*k) < value;
+    });
+    // keys sharing the prefix follow the lower bound contiguously
+    last = std::partition_point(first, last, [&courses, k, prefix](uint32_t pos) {
+        return std::string_view(courses[pos].*k).substr(0, prefix.size()) == prefix;
+    });
+    return PositionRange{ first, last };
+}
+
+/**
+ * Run fn(begin, end) over [0, count) split across up to threads workers
+ */
+template<typename Fn>
+void parallelFor(size_t count, unsigned int threads, Fn fn) {
+    if (threads <= 1 || count < 2) {
+        fn(static_cast<size_t>(0), count);
+        return;
+    }
+
+    size_t chunk = (count + threads - 1) / threads;
+    vector<std::thread> workers;
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+        workers.emplace_back(fn, begin, std::min(count, begin + chunk));
+    }
+    fn(static_cast<size_t>(0), chunk);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// prerequisite lists parsed into a compressed sparse row graph of course positions
+class PrereqGraph {
+public:
+    // dense closure is only kept while it fits this budget
+    static const size_t CLOSURE_LIMIT_BYTES = 256u << 20;
+
+    PrereqGraph();
+    void build(const vector<Course>& courses, const CourseIndex& byId);
+    vector<uint32_t> prerequisitesOf(uint32_t course) const;
+    vector<uint32_t> dependentsOf(uint32_t course) const;
+    bool dependsOn(uint32_t course, uint32_t prerequisite) const;
+    bool canTake(uint32_t course, const vector<uint32_t>& completed) const;
+    const vector<uint32_t>& cycles() const;
+    size_t unresolved() const;
+
+private:
+    vector<uint32_t> reach(uint32_t start, const vector<uint32_t>& offsets, const vector<uint32_t>& targets) const;
+    void buildClosure(const vector<uint32_t>& order, size_t acyclic);
+    void findCycles(const vector<uint32_t>& remaining);
+
+    friend class Snapshot;
+    vector<uint32_t> prereqOffsets; // course -> direct prerequisites
+    vector<uint32_t> prereqTargets;
+    vector<uint32_t> dependOffsets; // course -> direct dependents
+    vector<uint32_t> dependTargets;
+    vector<uint32_t> cyclic;        // courses that sit on a cycle
+    vector<uint64_t> closure;       // one bit row per course, empty if over budget
+    size_t words;
+    size_t missing;
+};
+
+PrereqGraph::PrereqGraph() {
+    words = 0;
+    missing = 0;
+}
+
+/**
+ * Parse every prerequisites string once and build the graph, its
+ * reverse, the cycle list and (budget permitting) the transitive closure
+ *
+ * @param courses the courses, their positions become the graph's vertices
+ * @param byId an index built over the same courses
+ */
+void PrereqGraph::build(const vector<Course>& courses, const CourseIndex& byId) {
+    size_t n = courses.size();
+
+    prereqOffsets.assign(n + 1, 0);
+    prereqTargets.clear();
+    missing = 0;
+
+    // ids are separated by blanks, commas, semicolons or pipes, maybe quoted
+    for (size_t i = 0; i < n; ++i) {
+        std::string_view list(courses[i].prerequisites);
+        size_t pos = 0;
+
+        while (pos < list.size()) {
+            size_t start = list.find_first_not_of(" \t\",;|", pos);
+            if (start == std::string_view::npos) {
+                break;
+            }
+            size_t stop = list.find_first_of(" \t\",;|", start);
+            if (stop == std::string_view::npos) {
+                stop = list.size();
+            }
+
+            const Course* prereq = byId.find(courses, list.substr(start, stop - start));
+            if (prereq != nullptr) {
+                prereqTargets.push_back(static_cast<uint32_t>(prereq - courses.data()));
+            }
+            else {
+                ++missing;
+            }
+            pos = stop;
+        }
+        prereqOffsets[i + 1] = static_cast<uint32_t>(prereqTargets.size());
+    }
+
+    // reverse edges by counting sort
+    dependOffsets.assign(n + 1, 0);
+    dependTargets.assign(prereqTargets.size(), 0);
+    for (uint32_t target : prereqTargets) {
+        ++dependOffsets[target + 1];
+    }
+    for (size_t i = 0; i < n; ++i) {
+        dependOffsets[i + 1] += dependOffsets[i];
+    }
+    vector<uint32_t> fill(dependOffsets.begin(), dependOffsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        for (uint32_t e = prereqOffsets[i]; e < prereqOffsets[i + 1]; ++e) {
+            dependTargets[fill[prereqTargets[e]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Kahn's algorithm: prerequisites come before their dependents
+    vector<uint32_t> pending(n);
+    vector<uint32_t> order;
+    order.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        pending[i] = prereqOffsets[i + 1] - prereqOffsets[i];
+        if (pending[i] == 0) {
+            order.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        uint32_t v = order[head];
+        for (uint32_t e = dependOffsets[v]; e < dependOffsets[v + 1]; ++e) {
+            if (--pending[dependTargets[e]] == 0) {
+                order.push_back(dependTargets[e]);
+            }
+        }
+    }
+
+    // whatever Kahn could not reach is on a cycle or behind one
+    size_t acyclic = order.size();
+    vector<uint32_t> remaining;
+    for (size_t i = 0; i < n; ++i) {
+        if (pending[i] != 0) {
+            remaining.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    findCycles(remaining);
+    order.insert(order.end(), remaining.begin(), remaining.end());
+
+    buildClosure(order, acyclic);
+}
+
+/**
+ * Tarjan's strongly connected components over the leftover courses,
+ * iterative so long chains cannot overflow the stack
+ */
+void PrereqGraph::findCycles(const vector<uint32_t>& remaining) {
+    const uint32_t UNSEEN = UINT32_MAX;
+    size_t n = prereqOffsets.size() - 1;
+    vector<uint32_t> index(n, UNSEEN);
+    vector<uint32_t> low(n, 0);
+    vector<char> onStack(n, 0);
+    vector<uint32_t> stack;
+    vector<pair<uint32_t, uint32_t> > calls; // (course, next edge)
+    uint32_t counter = 0;
+
+    cyclic.clear();
+    for (uint32_t root : remaining) {
+        if (index[root] != UNSEEN) {
+            continue;
+        }
+        calls.emplace_back(root, prereqOffsets[root]);
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        onStack[root] = 1;
+
+        while (!calls.empty()) {
+            uint32_t v = calls.back().first;
+            uint32_t& e = calls.back().second;
+
+            if (e < prereqOffsets[v + 1]) {
+                uint32_t w = prereqTargets[e++];
+                if (index[w] == UNSEEN) {
+                    index[w] = low[w] = counter++;
+                    stack.push_back(w);
+                    onStack[w] = 1;
+                    calls.emplace_back(w, prereqOffsets[w]);
+                }
+                else if (onStack[w]) {
+                    low[v] = std::min(low[v], index[w]);
+                }
+                continue;
+            }
+
+            calls.pop_back();
+            if (!calls.empty()) {
+                uint32_t parent = calls.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+            if (low[v] == index[v]) {
+                size_t top = stack.size();
+                uint32_t w;
+                do {
+                    w = stack[--top];
+                    onStack[w] = 0;
+                } while (w != v);
+
+                // a lone course only counts when it lists itself
+                bool selfLoop = std::find(prereqTargets.begin() + prereqOffsets[v],
+                    prereqTargets.begin() + prereqOffsets[v + 1], v) != prereqTargets.begin() + prereqOffsets[v + 1];
+                if (stack.size() - top > 1 || selfLoop) {
+                    cyclic.insert(cyclic.end(), stack.begin() + top, stack.end());
+                }
+                stack.resize(top);
+            }
+        }
+    }
+    std::sort(cyclic.begin(), cyclic.end());
+}
+
+/**
+ * Fill one bit row per course with all of its transitive prerequisites.
+ * Courses are handled level by level in topological order; a level only
+ * reads rows of earlier levels, so its courses are split across threads.
+ *
+ * @param order acyclic courses in topological order, then the rest
+ * @param acyclic how many courses at the front of order are acyclic
+ */
+void PrereqGraph::buildClosure(const vector<uint32_t>& order, size_t acyclic) {
+    size_t n = prereqOffsets.size() - 1;
+
+    words = (n + 63) / 64;
+    closure.clear();
+    if (n == 0 || n * words * sizeof(uint64_t) > CLOSURE_LIMIT_BYTES) {
+        return;
+    }
+    closure.assign(n * words, 0);
+
+    // level = longest prerequisite chain below a course
+    vector<uint32_t> level(n, 0);
+    uint32_t depth = 0;
+    for (size_t i = 0; i < acyclic; ++i) {
+        uint32_t v = order[i];
+        for (uint32_t e = prereqOffsets[v]; e < prereqOffsets[v + 1]; ++e) {
+            level[v] = std::max(level[v], level[prereqTargets[e]] + 1);
+        }
+        depth = std::max(depth, level[v]);
+    }
+    vector<uint32_t> byLevel(order.begin(), order.begin() + acyclic);
+    std::stable_sort(byLevel.begin(), byLevel.end(), [&level](uint32_t a, uint32_t b) {
+        return level[a] < level[b];
+    });
+
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t first = 0;
+    while (first < byLevel.size()) {
+        size_t last = first;
+        while (last < byLevel.size() && level[byLevel[last]] == level[byLevel[first]]) {
+            ++last;
+        }
+
+        const uint32_t* batch = byLevel.data() + first;
+        parallelFor(last - first, (last - first) < 1024 ? 1 : threads, [this, batch](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t v = batch[i];
+                uint64_t* row = &closure[v * words];
+                for (uint32_t e = prereqOffsets[v]; e < prereqOffsets[v + 1]; ++e) {
+                    uint32_t p = prereqTargets[e];
+                    const uint64_t* from = &closure[p * words];
+                    for (size_t w = 0; w < words; ++w) {
+                        row[w] |= from[w];
+                    }
+                    row[p / 64] |= 1ULL << (p % 64);
+                }
+            }
+        });
+        first = last;
+    }
+
+    // courses on or behind a cycle are rare; walk them one by one
+    for (size_t i = acyclic; i < order.size(); ++i) {
+        uint32_t v = order[i];
+        for (uint32_t p : reach(v, prereqOffsets, prereqTargets)) {
+            closure[v * words + p / 64] |= 1ULL << (p % 64);
+        }
+    }
+}
+
+// breadth-first walk, nearest courses first, start excluded unless on a cycle
+vector<uint32_t> PrereqGraph::reach(uint32_t start, const vector<uint32_t>& offsets, const vector<uint32_t>& targets) const {
+    vector<uint32_t> found;
+    vector<char> seen(offsets.size() - 1, 0);
+    vector<uint32_t> queue(1, start);
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        uint32_t v = queue[head];
+        for (uint32_t e = offsets[v]; e < offsets[v + 1]; ++e) {
+            uint32_t w = targets[e];
+            if (!seen[w]) {
+                seen[w] = 1;
+                found.push_back(w);
+                queue.push_back(w);
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * All direct and indirect prerequisites of a course
+ *
+ * @param course position of the course
+ */
+vector<uint32_t> PrereqGraph::prerequisitesOf(uint32_t course) const {
+    return reach(course, prereqOffsets, prereqTargets);
+}
+
+/**
+ * All courses that directly or indirectly require a course
+ *
+ * @param course position of the course
+ */
+vector<uint32_t> PrereqGraph::dependentsOf(uint32_t course) const {
+    return reach(course, dependOffsets, dependTargets);
+}
+
+/**
+ * Whether prerequisite is a direct or indirect prerequisite of course
+ * Performance: O(1) with the closure, a graph walk without it
+ */
+bool PrereqGraph::dependsOn(uint32_t course, uint32_t prerequisite) const {
+    if (!closure.empty()) {
+        return (closure[course * words + prerequisite / 64] >> (prerequisite % 64)) & 1;
+    }
+    vector<uint32_t> all = prerequisitesOf(course);
+    return std::find(all.begin(), all.end(), prerequisite) != all.end();
+}
+
+/**
+ * Whether a student who completed the given courses has every direct
+ * and indirect prerequisite of course
+ *
+ * @param course position of the course
+ * @param completed positions of the completed courses
+ */
+bool PrereqGraph::canTake(uint32_t course, const vector<uint32_t>& completed) const {
+    size_t n = prereqOffsets.size() - 1;
+    vector<uint64_t> done((n + 63) / 64, 0);
+    for (uint32_t c : completed) {
+        done[c / 64] |= 1ULL << (c % 64);
+    }
+
+    if (!closure.empty()) {
+        const uint64_t* row = &closure[course * words];
+        for (size_t w = 0; w < words; ++w) {
+            if (row[w] & ~done[w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    for (uint32_t p : prerequisitesOf(course)) {
+        if (!((done[p / 64] >> (p % 64)) & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Courses that sit on a prerequisite cycle, in position order
+ */
+const vector<uint32_t>& PrereqGraph::cycles() const {
+    return cyclic;
+}
+
+/**
+ * How many prerequisite ids did not match any course
+ */
+size_t PrereqGraph::unresolved() const {
+    return missing;
+}
+
+// one fuzzy search hit
+struct FuzzyMatch {
+    uint32_t course;   // position in the catalog
+    unsigned distance; // edits between the query and the id, or the closest stretch of the title
+    bool byTitle;      // matched in the title rather than the id
+    double score;      // 1 for an exact match, down to 0
+};
+
+// trigram index over course ids and titles for typo tolerant search.
+// Courses sharing enough trigrams with the query are the candidates;
+// each one is verified with a bit-parallel edit distance (Myers), and
+// only the best k are ranked. Matching ignores ASCII case.
+class FuzzyIndex {
+public:
+    void build(const vector<Course>& courses);
+    vector<FuzzyMatch> search(const vector<Course>& courses, std::string_view query, size_t k = 10, int maxDistance = -1) const;
+
+private:
+    // 64 symbols per character, see symbol()
+    static const uint32_t GRAM_COUNT = 64 * 64 * 64;
+    // longest query verified, one machine word of pattern bits
+    static const size_t MAX_QUERY = 64;
+
+    // trigram -> course positions, in position order
+    struct Grams {
+        vector<uint32_t> offsets;
+        vector<uint32_t> postings;
+
+        void build(const vector<Course>& courses, std::string_view Course::* field);
+        PositionRange list(uint32_t gram) const;
+    };
+
+    static unsigned symbol(unsigned char c);
+    static void gramsOf(std::string_view text, vector<uint32_t>& grams);
+    static unsigned editDistance(std::string_view text, const uint64_t* peq, size_t m, bool anywhere);
+    void candidates(const Grams& grams, const vector<uint32_t>& query, size_t needed, size_t courseCount, vector<uint32_t>& out) const;
+
+    Grams ids;
+    Grams titles;
+};
+
+/**
+ * Map a byte to one of 64 trigram symbols: 0 pads a word, letters
+ * ignore case, digits keep their own, everything else shares the rest.
+ */
+unsigned FuzzyIndex::symbol(unsigned char c) {
+    if (c >= 'a' && c <= 'z') {
+        return 1 + c - 'a';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 1 + c - 'A';
+    }
+    if (c >= '0' && c <= '9') {
+        return 27 + c - '0';
+    }
+    return 37 + c % 27;
+}
+
+/**
+ * The distinct trigrams of a text, each word padded at both ends,
+ * so a word of n characters has n trigrams
+ */
+void FuzzyIndex::gramsOf(std::string_view text, vector<uint32_t>& grams) {
+    grams.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t start = text.find_first_not_of(" \t", pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t stop = std::min(text.find_first_of(" \t", start), text.size());
+        uint32_t a = 0;
+        uint32_t b = symbol(text[start]);
+        for (size_t i = start + 1; i <= stop; ++i) {
+            uint32_t c = i < stop ? symbol(text[i]) : 0;
+            grams.push_back((a << 12) | (b << 6) | c);
+            a = b;
+            b = c;
+        }
+        pos = stop;
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+}
+
+/**
+ * Count, then place, every trigram of one field of every course
+ */
+void FuzzyIndex::Grams::build(const vector<Course>& courses, std::string_view Course::* field) {
+    vector<uint32_t> grams;
+    offsets.assign(GRAM_COUNT + 1, 0);
+    for (const Course& course : courses) {
+        gramsOf(course.*field, grams);
+        for (uint32_t gram : grams) {
+            ++offsets[gram + 1];
+        }
+    }
+    for (uint32_t gram = 0; gram < GRAM_COUNT; ++gram) {
+        offsets[gram + 1] += offsets[gram];
+    }
+
+    postings.resize(offsets[GRAM_COUNT]);
+    vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (uint32_t pos = 0; pos < courses.size(); ++pos) {
+        gramsOf(courses[pos].*field, grams);
+        for (uint32_t gram : grams) {
+            postings[next[gram]++] = pos;
+        }
+    }
+}
+
+PositionRange FuzzyIndex::Grams::list(uint32_t gram) const {
+    return PositionRange{ postings.data() + offsets[gram], postings.data() + offsets[gram + 1] };
+}
+
+/**
+ * Rebuild the index over the given courses
+ * Performance: O(total text length)
+ */
+void FuzzyIndex::build(const vector<Course>& courses) {
+    ids.build(courses, &Course::courseId);
+    titles.build(courses, &Course::title);
+}
+
+/**
+ * Edit distance between the pattern and the text, 64 pattern characters
+ * per step (Myers 1999, in Hyyro's formulation)
+ *
+ * @param peq for each byte, the pattern positions holding it
+ * @param m the pattern length, at most 64
+ * @param anywhere match the pattern against the closest stretch of the
+ *                 text instead of all of it
+ */
+unsigned FuzzyIndex::editDistance(std::string_view text, const uint64_t* peq, size_t m, bool anywhere) {
+    const uint64_t high = uint64_t(1) << (m - 1);
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    unsigned score = static_cast<unsigned>(m);
+    unsigned best = score;
+
+    for (char ch : text) {
+        uint64_t eq = peq[static_cast<unsigned char>(ch)];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) {
+            ++score;
+        }
+        else if (mh & high) {
+            --score;
+        }
+        // the top row counts text characters skipped, unless a match may start anywhere
+        ph = (ph << 1) | (anywhere ? 0 : 1);
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = std::min(best, score);
+    }
+    return anywhere ? best : score;
+}
+
+/**
+ * Courses that may share needed of the query trigrams. Any such course
+ * holds at least one of the query.size() - needed + 1 rarest ones, so
+ * only those lists must be read; the other short ones are read too, as
+ * every list read raises the count a course needs to stay a candidate.
+ * With needed 0 a course sharing no trigram at all may still match, so
+ * every course is a candidate.
+ */
+void FuzzyIndex::candidates(const Grams& grams, const vector<uint32_t>& query, size_t needed, size_t courseCount, vector<uint32_t>& out) const {
+    out.clear();
+    if (needed == 0) {
+        for (size_t pos = 0; pos < courseCount; ++pos) {
+            out.push_back(static_cast<uint32_t>(pos));
+        }
+        return;
+    }
+
+    // counts per course, cleared again through the courses touched; at most 64 trigrams fit a query
+    thread_local vector<unsigned char> counted;
+    counted.resize(std::max(counted.size(), courseCount));
+
+    vector<PositionRange> lists;
+    for (uint32_t gram : query) {
+        lists.push_back(grams.list(gram));
+    }
+    std::sort(lists.begin(), lists.end(), [](const PositionRange& a, const PositionRange& b) {
+        return a.size() < b.size();
+    });
+    size_t read = lists.size() - needed + 1;
+    const size_t shortList = courseCount / 64;
+    while (read < lists.size() && lists[read].size() <= shortList) {
+        ++read;
+    }
+    size_t skipped = lists.size() - read;
+    unsigned char least = static_cast<unsigned char>(needed > skipped ? needed - skipped : 1);
+
+    for (size_t i = 0; i < read; ++i) {
+        for (uint32_t pos : lists[i]) {
+            if (counted[pos]++ == 0) {
+                out.push_back(pos);
+            }
+        }
+    }
+    size_t kept = 0;
+    for (uint32_t pos : out) {
+        if (counted[pos] >= least) {
+            out[kept++] = pos;
+        }
+        counted[pos] = 0;
+    }
+    out.resize(kept);
+}
+
+/**
+ * The courses whose id is within maxDistance edits of the query, or whose
+ * title holds a stretch within maxDistance edits, best first: fewest
+ * edits, then id before title matches, then shortest text.
+ * Performance: proportional to the candidates, not the catalog
+ *
+ * @param courses the courses the index was built over
+ * @param query at most its first 64 characters are used
+ * @param k the most matches to return
+ * @param maxDistance edits allowed, -1 picks 0 to 2 by query length
+ */
+vector<FuzzyMatch> FuzzyIndex::search(const vector<Course>& courses, std::string_view query, size_t k, int maxDistance) const {
+    CSV_SCOPE(FUZZY_SEARCH);
+    query = query.substr(0, MAX_QUERY);
+    while (!query.empty() && (query.back() == ' ' || query.back() == '\t')) {
+        query.remove_suffix(1);
+    }
+    while (!query.empty() && (query.front() == ' ' || query.front() == '\t')) {
+        query.remove_prefix(1);
+    }
+    vector<FuzzyMatch> matches;
+    if (query.empty() || k == 0 || ids.offsets.empty()) {
+        return matches;
+    }
+    const size_t m = query.size();
+    unsigned allowed = maxDistance >= 0 ? static_cast<unsigned>(maxDistance) : m <= 2 ? 0 : m <= 10 ? 1 : 2;
+    allowed = std::min<unsigned>(allowed, static_cast<unsigned>(m - 1));
+
+    uint64_t peq[256] = {};
+    for (size_t i = 0; i < m; ++i) {
+        unsigned char c = static_cast<unsigned char>(query[i]);
+        peq[c] |= uint64_t(1) << i;
+        peq[static_cast<unsigned char>(std::tolower(c))] |= uint64_t(1) << i;
+        peq[static_cast<unsigned char>(std::toupper(c))] |= uint64_t(1) << i;
+    }
+
+    vector<uint32_t> grams;
+    gramsOf(query, grams);
+
+    // each edit spoils at most three trigrams; in a title the query may
+    // also start or end inside a word, losing a padded trigram at either end
+    size_t spoiled = 3 * allowed;
+    size_t needed = grams.size() > spoiled ? grams.size() - spoiled : 0;
+    vector<uint32_t> found;
+    candidates(ids, grams, needed, courses.size(), found);
+    for (uint32_t pos : found) {
+        std::string_view id = courses[pos].courseId;
+        size_t gap = id.size() > m ? id.size() - m : m - id.size();
+        if (gap > allowed) {
+            continue;
+        }
+        unsigned distance = editDistance(id, peq, m, false);
+        if (distance <= allowed) {
+            matches.push_back({ pos, distance, false, 0.0 });
+        }
+    }
+
+    spoiled += 2;
+    needed = grams.size() > spoiled ? grams.size() - spoiled : 0;
+    candidates(titles, grams, needed, courses.size(), found);
+    for (uint32_t pos : found) {
+        if (courses[pos].title.size() + allowed < m) {
+            continue;
+        }
+        unsigned distance = editDistance(courses[pos].title, peq, m, true);
+        if (distance <= allowed) {
+            matches.push_back({ pos, distance, true, 0.0 });
+        }
+    }
+
+    auto better = [&courses](const FuzzyMatch& a, const FuzzyMatch& b) {
+        if (a.distance != b.distance) {
+            return a.distance < b.distance;
+        }
+        if (a.byTitle != b.byTitle) {
+            return !a.byTitle;
+        }
+        size_t lengthA = a.byTitle ? courses[a.course].title.size() : courses[a.course].courseId.size();
+        size_t lengthB = b.byTitle ? courses[b.course].title.size() : courses[b.course].courseId.size();
+        if (lengthA != lengthB) {
+            return lengthA < lengthB;
+        }
+        return a.course < b.course;
+    };
+
+    // a course matched by id and by title counts once, by its better match
+    std::sort(matches.begin(), matches.end(), [&better](const FuzzyMatch& a, const FuzzyMatch& b) {
+        return a.course != b.course ? a.course < b.course : better(a, b);
+    });
+    matches.erase(std::unique(matches.begin(), matches.end(), [](const FuzzyMatch& a, const FuzzyMatch& b) {
+        return a.course == b.course;
+    }), matches.end());
+
+    size_t top = std::min(k, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + top, matches.end(), better);
+    matches.resize(top);
+    for (FuzzyMatch& match : matches) {
+        match.score = 1.0 - static_cast<double>(match.distance) / m;
+    }
+    return matches;
+}
+
+// one keyword search hit
+struct TitleMatch {
+    uint32_t course; // position in the catalog
+    double score;    // BM25, higher is better
+};
+
+// inverted index from the words of course titles to the courses using
+// them. Each word's postings (course position, times used) are delta
+// and varint coded in blocks of BLOCK_SIZE, with the last course of every
+// block kept aside, so a cursor can gallop past whole blocks without
+// decoding them. Words are runs of letters and digits, ASCII lower cased.
+class TitleIndex {
+public:
+    enum Match { eALL_WORDS, eANY_WORD };
+
+    void build(const vector<Course>& courses);
+    vector<TitleMatch> search(std::string_view query, Match match = eALL_WORDS, size_t k = 10) const;
+    size_t words() const;
+    size_t postingBytes() const;
+
+    template<typename Visit>
+    static void tokenize(std::string_view text, Visit visit);
+
+private:
+    static const uint32_t BLOCK_SIZE = 128;
+
+    struct Term {
+        uint32_t count;      // courses using the word
+        uint32_t firstBlock;
+    };
+    struct Block {
+        uint32_t last;   // last course in the block
+        uint32_t offset; // where its postings start in bytes
+    };
+    class Cursor;
+
+    double inverseFrequency(const Term& term) const;
+    double weight(double idf, uint32_t course, uint32_t uses) const;
+    void lookup(std::string_view query, Match match, vector<uint32_t>& terms) const;
+
+    std::unordered_map<string, uint32_t> dictionary;
+    vector<Term> terms;
+    vector<Block> blocks;
+    vector<uint8_t> bytes;
+    vector<uint16_t> lengths; // words per title, capped
+    double averageLength = 0;
+};
+
+// walks the postings of one word in course order
+class TitleIndex::Cursor {
+public:
+    Cursor(const TitleIndex& index, uint32_t word)
+        : index(index), term(index.terms[word]),
+          blockCount((index.terms[word].count + BLOCK_SIZE - 1) / BLOCK_SIZE),
+          idf(index.inverseFrequency(index.terms[word])) {
+        decode(0);
+    }
+
+    bool done() const { return block >= blockCount; }
+    uint32_t course() const { return courses[pos]; }
+    const Term& word() const { return term; }
+    double weight() const { return index.weight(idf, courses[pos], counts[pos]); }
+
+    void next() {
+        if (++pos == size) {
+            decode(block + 1);
+        }
+    }
+
+    /**
+     * Move to the first course at or after target: exponential then
+     * binary search over the block ends, one block decoded at the end
+     */
+    void seek(uint32_t target) {
+        if (done() || course() >= target) {
+            return;
+        }
+        const Block* first = index.blocks.data() + term.firstBlock;
+        if (first[block].last < target) {
+            size_t low = block;
+            size_t step = 1;
+            while (low + step < blockCount && first[low + step].last < target) {
+                low += step;
+                step *= 2;
+            }
+            size_t high = std::min(low + step, blockCount);
+            const Block* found = std::lower_bound(first + low + 1, first + high, target, [](const Block& b, uint32_t value) {
+                return b.last < value;
+            });
+            decode(found - first);
+            if (done()) {
+                return;
+            }
+        }
+        pos = static_cast<uint32_t>(std::lower_bound(courses + pos, courses + size, target) - courses);
+    }
+
+private:
+    void decode(size_t at) {
+        block = at;
+        pos = 0;
+        if (done()) {
+            return;
+        }
+        const Block* first = index.blocks.data() + term.firstBlock;
+        const uint8_t* it = index.bytes.data() + first[at].offset;
+        uint32_t previous = at == 0 ? 0 : first[at - 1].last;
+        size = term.count - static_cast<uint32_t>(at) * BLOCK_SIZE;
+        if (size > BLOCK_SIZE) {
+            size = BLOCK_SIZE;
+        }
+        for (uint32_t i = 0; i < size; ++i) {
+            previous += readVarint(it);
+            courses[i] = previous;
+            counts[i] = readVarint(it);
+        }
+    }
+
+    static uint32_t readVarint(const uint8_t*& it) {
+        uint32_t value = *it & 0x7f;
+        for (unsigned shift = 7; *it++ & 0x80; shift += 7) {
+            value |= uint32_t(*it & 0x7f) << shift;
+        }
+        return value;
+    }
+
+    const TitleIndex& index;
+    const Term& term;
+    size_t blockCount;
+    double idf;
+    size_t block = 0;
+    uint32_t pos = 0;
+    uint32_t size = 0;
+    uint32_t courses[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+};
+
+/**
+ * Call visit(std::string_view) with every word of text, lower cased;
+ * the view is only valid during the call
+ */
+template<typename Visit>
+void TitleIndex::tokenize(std::string_view text, Visit visit) {
+    char word[256];
+    size_t length = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (std::isalnum(c) || c >= 0x80) {
+            if (length < sizeof(word)) {
+                word[length++] = static_cast<char>(std::tolower(c));
+            }
+        }
+        else if (length > 0) {
+            visit(std::string_view(word, length));
+            length = 0;
+        }
+    }
+}
+
+/**
+ * Rebuild the index over the given courses
+ * Performance: O(total title length)
+ */
+void TitleIndex::build(const vector<Course>& courses) {
+    dictionary.clear();
+    terms.clear();
+    blocks.clear();
+    bytes.clear();
+    lengths.assign(courses.size(), 0);
+
+    // every title as a run of word ids
+    vector<uint32_t> words;
+    vector<uint32_t> starts{ 0 };
+    uint64_t total = 0;
+    for (uint32_t pos = 0; pos < courses.size(); ++pos) {
+        tokenize(courses[pos].title, [&](std::string_view word) {
+            auto inserted = dictionary.emplace(string(word), static_cast<uint32_t>(dictionary.size()));
+            words.push_back(inserted.first->second);
+        });
+        size_t length = words.size() - starts.back();
+        lengths[pos] = static_cast<uint16_t>(std::min<size_t>(length, UINT16_MAX));
+        total += length;
+        starts.push_back(static_cast<uint32_t>(words.size()));
+    }
+    averageLength = courses.empty() ? 0 : static_cast<double>(total) / courses.size();
+
+    // group the (course, uses) pairs by word, courses in order
+    terms.assign(dictionary.size(), Term{ 0, 0 });
+    vector<uint32_t> offsets(dictionary.size() + 1, 0);
+    for (uint32_t pos = 0; pos < courses.size(); ++pos) {
+        std::sort(words.begin() + starts[pos], words.begin() + starts[pos + 1]);
+        for (uint32_t i = starts[pos]; i < starts[pos + 1]; ++i) {
+            if (i == starts[pos] || words[i] != words[i - 1]) {
+                ++offsets[words[i] + 1];
+            }
+        }
+    }
+    for (size_t t = 0; t < terms.size(); ++t) {
+        terms[t].count = offsets[t + 1];
+        offsets[t + 1] += offsets[t];
+    }
+    vector<uint32_t> postings(offsets.back());
+    vector<uint32_t> uses(offsets.back());
+    for (uint32_t pos = 0; pos < courses.size(); ++pos) {
+        for (uint32_t i = starts[pos]; i < starts[pos + 1];) {
+            uint32_t word = words[i];
+            uint32_t j = i;
+            while (j < starts[pos + 1] && words[j] == word) {
+                ++j;
+            }
+            postings[offsets[word]] = pos;
+            uses[offsets[word]++] = j - i;
+            i = j;
+        }
+    }
+
+    auto writeVarint = [this](uint32_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    };
+    uint32_t at = 0;
+    for (Term& term : terms) {
+        term.firstBlock = static_cast<uint32_t>(blocks.size());
+        uint32_t previous = 0;
+        for (uint32_t i = 0; i < term.count; ++i, ++at) {
+            if (i % BLOCK_SIZE == 0) {
+                blocks.push_back(Block{ 0, static_cast<uint32_t>(bytes.size()) });
+            }
+            writeVarint(postings[at] - previous);
+            writeVarint(uses[at]);
+            previous = postings[at];
+            blocks.back().last = previous;
+        }
+    }
+    bytes.shrink_to_fit();
+}
+
+/**
+ * How many distinct words the titles use
+ */
+size_t TitleIndex::words() const {
+    return terms.size();
+}
+
+/**
+ * Size of the compressed postings
+ */
+size_t TitleIndex::postingBytes() const {
+    return bytes.size() + blocks.size() * sizeof(Block);
+}
+
+// how rare the word is: the BM25 idf
+double TitleIndex::inverseFrequency(const Term& term) const {
+    double n = static_cast<double>(lengths.size());
+    return std::log(1.0 + (n - term.count + 0.5) / (term.count + 0.5));
+}
+
+// BM25 with the usual k1 = 1.2, b = 0.75
+double TitleIndex::weight(double idf, uint32_t course, uint32_t uses) const {
+    const double k1 = 1.2;
+    const double b = 0.75;
+    double norm = k1 * (1.0 - b + b * lengths[course] / std::max(averageLength, 1.0));
+    return idf * uses * (k1 + 1.0) / (uses + norm);
+}
+
+// the distinct words of the query that are in the index; for eALL_WORDS,
+// none at all if any is missing
+void TitleIndex::lookup(std::string_view query, Match match, vector<uint32_t>& found) const {
+    bool missing = false;
+    tokenize(query, [&](std::string_view word) {
+        auto it = dictionary.find(string(word));
+        if (it == dictionary.end()) {
+            missing = true;
+        }
+        else if (std::find(found.begin(), found.end(), it->second) == found.end()) {
+            found.push_back(it->second);
+        }
+    });
+    if (missing && match == eALL_WORDS) {
+        found.clear();
+    }
+}
+
+/**
+ * The k courses whose titles best match the query words, best first
+ * Performance: for all words, proportional to the rarest word's courses
+ * times log of the others; for any word, to all their courses
+ *
+ * @param query words in any case, e.g. "machine learning"
+ * @param match whether a title needs every word or any one of them
+ */
+vector<TitleMatch> TitleIndex::search(std::string_view query, Match match, size_t k) const {
+    CSV_SCOPE(KEYWORD_SEARCH);
+    vector<TitleMatch> top;
+    vector<uint32_t> wanted;
+    lookup(query, match, wanted);
+    if (wanted.empty() || k == 0) {
+        return top;
+    }
+
+    // a min heap on score keeps the best k seen so far
+    auto worse = [](const TitleMatch& a, const TitleMatch& b) {
+        return a.score != b.score ? a.score > b.score : a.course < b.course;
+    };
+    auto offer = [&](uint32_t course, double score) {
+        if (top.size() < k) {
+            top.push_back({ course, score });
+            std::push_heap(top.begin(), top.end(), worse);
+        }
+        else if (worse(TitleMatch{ course, score }, top.front())) {
+            std::pop_heap(top.begin(), top.end(), worse);
+            top.back() = { course, score };
+            std::push_heap(top.begin(), top.end(), worse);
+        }
+    };
+
+    vector<std::unique_ptr<Cursor>> cursors;
+    for (uint32_t word : wanted) {
+        cursors.emplace_back(new Cursor(*this, word));
+    }
+
+    if (match == eALL_WORDS) {
+        // leapfrog from the rarest word; the others seek to its courses
+        std::sort(cursors.begin(), cursors.end(), [](const std::unique_ptr<Cursor>& a, const std::unique_ptr<Cursor>& b) {
+            return a->word().count < b->word().count;
+        });
+        Cursor& lead = *cursors[0];
+        bool exhausted = false;
+        while (!lead.done() && !exhausted) {
+            uint32_t course = lead.course();
+            double score = lead.weight();
+            bool all = true;
+            for (size_t i = 1; i < cursors.size(); ++i) {
+                Cursor& other = *cursors[i];
+                other.seek(course);
+                if (other.done()) {
+                    exhausted = true;
+                    all = false;
+                    break;
+                }
+                if (other.course() != course) {
+                    lead.seek(other.course());
+                    all = false;
+                    break;
+                }
+                score += other.weight();
+            }
+            if (all) {
+                offer(course, score);
+                lead.next();
+            }
+        }
+    }
+    else {
+        // merge all the lists at once, always taking the lowest course
+        while (true) {
+            uint32_t course = UINT32_MAX;
+            for (const std::unique_ptr<Cursor>& cursor : cursors) {
+                if (!cursor->done()) {
+                    course = std::min(course, cursor->course());
+                }
+            }
+            if (course == UINT32_MAX) {
+                break;
+            }
+            double score = 0;
+            for (const std::unique_ptr<Cursor>& cursor : cursors) {
+                if (!cursor->done() && cursor->course() == course) {
+                    score += cursor->weight();
+                    cursor->next();
+                }
+            }
+            offer(course, score);
+        }
+    }
+    std::sort_heap(top.begin(), top.end(), worse);
+    return top;
+}
+
+// an index over the courses that the writer builds before the catalog
+// is published, see CatalogHandle::install, so readers only ever search
+// a finished one and never wait for a build. A copy starts without one,
+// so the next generation never searches an index of courses it has
+// changed; a move keeps it
+template<typename Index>
+class PublishedIndex {
+public:
+    PublishedIndex() = default;
+    PublishedIndex(const PublishedIndex&) {}
+    PublishedIndex(PublishedIndex&&) = default;
+    PublishedIndex& operator=(const PublishedIndex&) {
+        reset();
+        return *this;
+    }
+    PublishedIndex& operator=(PublishedIndex&&) = default;
+
+    bool built() const {
+        return index != nullptr;
+    }
+    void build(const vector<Course>& courses) {
+        std::shared_ptr<Index> built = std::make_shared<Index>();
+        built->build(courses);
+        index = built;
+    }
+    // only on a published catalog
+    const Index& get() const {
+        return *index;
+    }
+    void reset() {
+        index.reset();
+    }
+
+private:
+    std::shared_ptr<const Index> index;
+};
+
+// the loaded courses together with the indexes built over them
+struct Catalog {
+    std::shared_ptr<StringPool> text = std::make_shared<StringPool>(); // owns the course strings
+    vector<Course> courses;
+    CourseIndex byId;
+    SortedIndex byTitle{ &Course::title };
+    SortedIndex byCourseId{ &Course::courseId };
+    // vertices are Course::node, not positions, so generations that only
+    // reorder the courses share one graph, closure included
+    std::shared_ptr<const PrereqGraph> prereqs = std::make_shared<PrereqGraph>();
+    vector<uint32_t> nodePositions; // prereqs vertex -> course position
+    std::shared_ptr<const MappedFile> image; // snapshot the views point into, if loaded from one
+    uint64_t generation = 0; // set when published, see CatalogHandle
+
+    PublishedIndex<FuzzyIndex> fuzzy;     // typo tolerant ids and titles, see fuzzyIndex()
+    PublishedIndex<TitleIndex> titleWords; // keyword search, see titleIndex()
+
+    // rebuild every index, call after the courses were loaded or changed
+    void reindex() {
+        byId.build(courses);
+        byTitle.build(courses);
+        byCourseId.build(courses);
+        buildPrereqs();
+        fuzzy.reset();
+        titleWords.reset();
+    }
+
+    void reorder();
+    void buildPrereqs();
+    void buildSearchIndexes();
+    vector<uint32_t> prerequisitesOf(uint32_t pos) const;
+    vector<uint32_t> dependentsOf(uint32_t pos) const;
+    bool onCycle(uint32_t pos) const;
+
+    // the search indexes, built when the catalog is published
+    const FuzzyIndex& fuzzyIndex() const {
+        return fuzzy.get();
+    }
+    const TitleIndex& titleIndex() const {
+        return titleWords.get();
+    }
+};
+
+/**
+ * Follow a reorder of the courses, e.g. a sort, for a fraction of the
+ * cost of reindex(): the position indexes are renamed through the
+ * permutation, which each course's node gives away, and the graph is
+ * kept as it is, shared with the generation before.
+ */
+void Catalog::reorder() {
+    const size_t n = courses.size();
+    vector<uint32_t> remap(n); // old position -> new position
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t& pos = nodePositions[courses[i].node];
+        remap[pos] = static_cast<uint32_t>(i);
+        pos = static_cast<uint32_t>(i);
+    }
+
+    // with repeated ids a rebuild keeps the first course in the new order
+    if (byId.size() == n) {
+        byId.reorder(remap);
+    }
+    else {
+        byId.build(courses);
+    }
+    byTitle.reorder(courses, remap);
+    byCourseId.reorder(courses, remap);
+    fuzzy.reset();
+    titleWords.reset();
+}
+
+// a new graph over the current positions, byId must be up to date
+void Catalog::buildPrereqs() {
+    std::shared_ptr<PrereqGraph> graph = std::make_shared<PrereqGraph>();
+    graph->build(courses, byId);
+    prereqs = graph;
+    nodePositions.resize(courses.size());
+    for (size_t i = 0; i < courses.size(); ++i) {
+        courses[i].node = static_cast<uint32_t>(i);
+        nodePositions[i] = static_cast<uint32_t>(i);
+    }
+}
+
+/**
+ * All direct and indirect prerequisites of a course, nearest first
+ *
+ * @param pos position of the course
+ * @return their positions
+ */
+vector<uint32_t> Catalog::prerequisitesOf(uint32_t pos) const {
+    vector<uint32_t> found = prereqs->prerequisitesOf(courses[pos].node);
+    for (uint32_t& node : found) {
+        node = nodePositions[node];
+    }
+    return found;
+}
+
+/**
+ * All courses that directly or indirectly require a course, nearest first
+ *
+ * @param pos position of the course
+ * @return their positions
+ */
+vector<uint32_t> Catalog::dependentsOf(uint32_t pos) const {
+    vector<uint32_t> found = prereqs->dependentsOf(courses[pos].node);
+    for (uint32_t& node : found) {
+        node = nodePositions[node];
+    }
+    return found;
+}
+
+// the fuzzy and keyword indexes, unless they are still current
+void Catalog::buildSearchIndexes() {
+    if (!fuzzy.built()) {
+        fuzzy.build(courses);
+    }
+    if (!titleWords.built()) {
+        titleWords.build(courses);
+    }
+}
+
+// whether the course at pos sits on a prerequisite cycle
+bool Catalog::onCycle(uint32_t pos) const {
+    const vector<uint32_t>& cycles = prereqs->cycles();
+    return std::binary_search(cycles.begin(), cycles.end(), courses[pos].node);
+}
+
+// the published catalog. Readers take the current generation and use it
+// for as long as they hold it; writers build the next generation off to
+// the side and swap it in, so a reader never waits for a reload or a sort
+// and never sees a half-built catalog. Old generations, with their string
+// pools, go away when their last reader lets go.
+//
+// The pointer itself is guarded by a mutex held only to copy or swap it.
+// The free std::atomic_load/atomic_store overloads for shared_ptr are
+// deprecated in C++20, and std::atomic<std::shared_ptr> needs C++20 and is
+// not lock-free in the common standard libraries either, so a short lock
+// costs about the same and builds everywhere.
+class CatalogHandle {
+public:
+    CatalogHandle();
+    std::shared_ptr<const Catalog> current() const;
+    uint64_t generation() const;
+    void publish(Catalog next);
+    template<typename Change>
+    void update(Change change);
+
+private:
+    void install(Catalog&& next);
+
+    mutable std::mutex swapping;         // guards live, held for a copy or a swap only
+    std::shared_ptr<const Catalog> live; // guarded by swapping
+    std::mutex writers;                  // one writer at a time, readers never take it
+    uint64_t published;                  // guarded by writers
+};
+
+CatalogHandle::CatalogHandle() {
+    published = 0;
+    Catalog empty;
+    empty.buildSearchIndexes();
+    live = std::make_shared<const Catalog>(std::move(empty));
+}
+
+/**
+ * The catalog as of now; stays valid and unchanged while held
+ */
+std::shared_ptr<const Catalog> CatalogHandle::current() const {
+    std::lock_guard<std::mutex> lock(swapping);
+    return live;
+}
+
+uint64_t CatalogHandle::generation() const {
+    return current()->generation;
+}
+
+/**
+ * Replace the catalog, e.g. after a reload
+ */
+void CatalogHandle::publish(Catalog next) {
+    std::lock_guard<std::mutex> lock(writers);
+    install(std::move(next));
+}
+
+/**
+ * Publish a changed copy of the current catalog, e.g. resorted. Readers
+ * keep the old generation meanwhile; the copy shares its strings.
+ *
+ * @param change called with the copy, as void(Catalog&), or as
+ *        bool(Catalog&) returning false to publish nothing
+ */
+template<typename Change>
+void CatalogHandle::update(Change change) {
+    std::lock_guard<std::mutex> lock(writers);
+    Catalog next = *current();
+    if constexpr (std::is_same<decltype(change(next)), bool>::value) {
+        if (!change(next)) {
+            return;
+        }
+    }
+    else {
+        change(next);
+    }
+    install(std::move(next));
+}
+
+// writers held; the search indexes are built here, before readers can see the catalog
+void CatalogHandle::install(Catalog&& next) {
+    next.buildSearchIndexes();
+    next.generation = ++published;
+    std::shared_ptr<const Catalog> installed = std::make_shared<const Catalog>(std::move(next));
+    std::lock_guard<std::mutex> lock(swapping);
+    live.swap(installed);
+}
+
+CatalogHandle catalog;
+//============================================================================
+// Static methods used for testing
+//============================================================================
+
+/**
+ * Display the course information to the console (std::out)
+ *
+ * @param course struct containing the course info
+ */
+void displayCourse(const Course& course) {
+    std::cout << course.title << ": " << course.courseId << " | " << course.amount << " | "
+        << course.prerequisites << '\n';
+    return;
+}
+/**
+* Search for the specified courseId in one catalog generation
+*
+* @param generation the catalog to search, e.g. *catalog.current()
+* @param courseId The course id to search for
+* @return the course, valid while the generation is held, or nullptr if there is none
+*/
+const Course* SearchCourse(const Catalog& generation, std::string_view courseId) {
+    CSV_SCOPE(SEARCH);
+    return generation.byId.find(generation.courses, courseId);
+}
+/**
+* Search for the specified courseId in the current catalog
+*
+* @param courseId The course id to search for
+* @return the course in the catalog, or nullptr if there is none; only
+*         valid until the next publish, unless the caller holds that generation
+*/
+const Course* SearchCourse(const string& courseId) {
+    return SearchCourse(*catalog.current(), courseId);
+}
+/**
+ * Copy a prerequisite list into the pool; the ids named in it share
+ * its bytes with the courses they name
+ *
+ * @return the stored list
+ */
+std::string_view storePrerequisites(StringPool& text, std::string_view prerequisites) {
+    std::string_view list = text.store(prerequisites);
+    for (size_t pos = 0; pos < list.size();) {
+        size_t start = list.find_first_not_of(" \t\",;|", pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t stop = std::min(list.find_first_of(" \t\",;|", start), list.size());
+        text.share(list.substr(start, stop - start));
+        pos = stop;
+    }
+    return list;
+}
+
+/**
+ * Load a CSV file containing courses into a catalog
+ *
+ * @param csvPath the path to the CSV file to load
+ * @param complete if given, set to false when the file could not be read to the end
+ * @return a catalog holding all the courses read, already indexed
+ * @throw Error if the header lacks a course column, rather than loading nothing
+ */
+Catalog loadCourses(string csvPath, bool* complete = nullptr) {
+    CSV_SCOPE(LOAD_COURSES);
+    std::cout << "Loading CSV file " << csvPath << endl;
+
+    // Define a vector data structure to hold a collection of courses.
+    Catalog loaded;
+    vector<Course>& courses = loaded.courses;
+    StringPool& text = *loaded.text;
+
+    // map the CSV file and split it in parallel
+    std::unique_ptr<Parser> file;
+    try {
+        file.reset(new Parser(csvPath, eMMAP, ',', 0));
+    }
+    catch (Error& e) {
+        std::cerr << e.what() << std::endl;
+        if (complete != nullptr) {
+            *complete = false;
+        }
+        loaded.reindex();
+        return loaded;
+    }
+
+    // then bind its columns by header name; the fields are views into the
+    // mapping, so each value is copied exactly once, into the pool
+    courses.reserve(file->rowCount());
+    RecordParser<CourseColumns>().forEachRecord(*file, [&courses, &text](Course& course) {
+        course.title = text.store(course.title);
+        course.courseId = text.intern(course.courseId);
+        course.prerequisites = storePrerequisites(text, course.prerequisites);
+
+        // push this course to the end
+        courses.push_back(course);
+    });
+
+    loaded.reindex();
+    return loaded;
+}
+
+// what an incremental reload changed, by course id
+struct ChangeSet {
+    vector<string> added;
+    vector<string> updated;
+    vector<string> removed;
+
+    bool empty() const {
+        return added.empty() && updated.empty() && removed.empty();
+    }
+};
+
+/**
+ * Bring a catalog up to date with its CSV file, touching only what
+ * changed. Every record is compared, by courseId, with the course already
+ * in the catalog. Courses missing from the file are removed, new ones are
+ * appended. The indexes are patched, not rebuilt, unless ids or
+ * prerequisites changed. If anything changed, the catalog gets a string
+ * pool of its own holding just its live text, so replaced titles go away
+ * with the last generation that shows them instead of piling up in a
+ * pool every generation shares.
+ * A repeated courseId is matched occurrence by occurrence: its n-th record
+ * in the file is compared with its n-th course in the catalog, so the
+ * result holds the same courses as a full load, if not always at the
+ * same positions.
+ *
+ * @param catalog the catalog to update, e.g. the next generation in CatalogHandle::update
+ * @param csvPath the path to the CSV file to load
+ * @param changes filled with the ids added, updated and removed
+ * @return false if nothing changed; the catalog is then left as it was
+ * @throw Error if the file cannot be read; the catalog may be half updated
+ */
+bool reloadCourses(Catalog& catalog, const string& csvPath, ChangeSet& changes) {
+    CSV_SCOPE(LOAD_COURSES);
+    vector<Course>& courses = catalog.courses;
+    const size_t n = courses.size();
+
+    vector<bool> seen(n, false);
+    vector<uint32_t> retitled;   // positions updated in place
+    vector<Course> fresh;        // new courses, in file order
+    bool prerequisitesChanged = false;
+
+    // byId holds the first course of each id; chain the later ones, if any
+    vector<uint32_t> nextSame;
+    if (catalog.byId.size() != n) {
+        nextSame.assign(n, UINT32_MAX);
+        vector<uint32_t> last(n);
+        for (size_t i = 0; i < n; ++i) {
+            size_t first = catalog.byId.find(courses, courses[i].courseId) - courses.data();
+            if (first != i) {
+                nextSame[last[first]] = static_cast<uint32_t>(i);
+            }
+            last[first] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // new and changed text stays a view into the file until the new pool is filled
+    changes = ChangeSet();
+    Parser file(csvPath, eMMAP, ',', 0);
+    RecordParser<CourseColumns>().forEachRecord(file, [&](const Course& record) {
+        std::string_view courseId = record.courseId;
+        const Course* existing = catalog.byId.find(courses, courseId);
+
+        // the first course with this id the file has not matched yet
+        size_t pos = existing == nullptr ? SIZE_MAX : existing - courses.data();
+        while (pos != SIZE_MAX && seen[pos]) {
+            pos = nextSame.empty() || nextSame[pos] == UINT32_MAX ? SIZE_MAX : nextSame[pos];
+        }
+
+        if (pos == SIZE_MAX) {
+            Course course;
+            course.courseId = courseId;
+            course.title = record.title;
+            course.prerequisites = record.prerequisites;
+            fresh.push_back(course);
+            changes.added.emplace_back(courseId);
+            return;
+        }
+        seen[pos] = true;
+
+        Course& course = courses[pos];
+        if (course.title == record.title && course.prerequisites == record.prerequisites) {
+            return;
+        }
+        if (course.title != record.title) {
+            course.title = record.title;
+            retitled.push_back(static_cast<uint32_t>(pos));
+        }
+        if (course.prerequisites != record.prerequisites) {
+            course.prerequisites = record.prerequisites;
+            prerequisitesChanged = true;
+        }
+        changes.updated.emplace_back(courseId);
+    });
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!seen[i]) {
+            changes.removed.emplace_back(courses[i].courseId);
+        }
+    }
+    if (changes.empty()) {
+        return false;
+    }
+
+    // the live text only, copied once, in the order a full load stores it
+    std::shared_ptr<StringPool> pool = std::make_shared<StringPool>();
+    for (vector<Course>* list : { &courses, &fresh }) {
+        for (size_t i = 0; i < list->size(); ++i) {
+            Course& course = (*list)[i];
+            if (list == &courses && !seen[i]) {
+                continue;
+            }
+            course.title = pool->store(course.title);
+            course.courseId = pool->intern(course.courseId);
+            course.prerequisites = storePrerequisites(*pool, course.prerequisites);
+        }
+    }
+    catalog.text = pool;
+    catalog.image.reset();
+
+    // drop the removed courses, keeping the order of the rest, then append the new ones
+    vector<uint32_t> remap;
+    vector<uint32_t> added;
+    if (!changes.removed.empty() || !fresh.empty()) {
+        remap.assign(n, UINT32_MAX);
+        size_t kept = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (seen[i]) {
+                remap[i] = static_cast<uint32_t>(kept);
+                courses[kept++] = courses[i];
+            }
+        }
+        courses.resize(kept);
+        for (const Course& course : fresh) {
+            added.push_back(static_cast<uint32_t>(courses.size()));
+            courses.push_back(course);
+        }
+        for (uint32_t& pos : retitled) {
+            pos = remap[pos];
+        }
+        catalog.byId.build(courses);
+    }
+
+    retitled.insert(retitled.end(), added.begin(), added.end());
+    catalog.byTitle.patch(courses, remap, retitled);
+    catalog.byCourseId.patch(courses, remap, added);
+    if (!remap.empty() || prerequisitesChanged) {
+        catalog.buildPrereqs();
+    }
+    catalog.fuzzy.reset();
+    catalog.titleWords.reset();
+    return true;
+}
+
+// snapshot file layout: header, then each section in SnapshotSection
+// order, integers in host byte order
+const char SNAPSHOT_MAGIC[8] = { 'C', 'S', '3', '0', '0', 'C', 'A', 'T' };
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+const char SNAPSHOT_SCHEMA[] = "courseId,title,prerequisites,amount";
+
+enum SnapshotSection {
+    SECTION_RECORDS,        // SnapshotRecord per course
+    SECTION_BY_TITLE,       // SortedIndex orders
+    SECTION_BY_COURSE_ID,
+    SECTION_ID_SLOTS,       // CourseIndex slots
+    SECTION_PREREQ_OFFSETS, // PrereqGraph arrays
+    SECTION_PREREQ_TARGETS,
+    SECTION_DEPEND_OFFSETS,
+    SECTION_DEPEND_TARGETS,
+    SECTION_CYCLES,
+    SECTION_CLOSURE,
+    SECTION_NODES,          // PrereqGraph vertex per course
+    SECTION_HEAP,           // course text
+    SECTION_COUNT
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;   // SNAPSHOT_BYTE_ORDER as written, catches foreign machines
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t checksum;    // of everything after the header
+    uint64_t closureWords;
+    uint64_t missing;
+    uint64_t counts[SECTION_COUNT]; // elements per section
+    char schema[64];      // field names, so a changed Course is never misread
+};
+
+// one course; text is (offset, length) in the heap
+struct SnapshotRecord {
+    double amount;
+    uint32_t idOffset;
+    uint32_t idLength;
+    uint32_t titleOffset;
+    uint32_t titleLength;
+    uint32_t prereqOffset;
+    uint32_t prereqLength;
+};
+
+/**
+ * Checksum of a snapshot body, 8 bytes per step so that validating
+ * stays far cheaper than parsing
+ */
+uint64_t snapshotChecksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// reads and writes whole catalogs, indexes included, as snapshot files
+class Snapshot {
+public:
+    static void save(const Catalog& catalog, const string& path);
+    static bool load(const string& path, Catalog& catalog);
+
+private:
+    static const size_t ELEMENT_SIZE[SECTION_COUNT];
+
+    template<typename T>
+    static void put(string& image, SnapshotHeader& header, SnapshotSection section, const vector<T>& values);
+    template<typename T>
+    static void get(const char* (&cursor), const SnapshotHeader& header, SnapshotSection section, vector<T>& values);
+    static bool validPositions(const vector<uint32_t>& values, size_t n);
+    static bool validAdjacency(const vector<uint32_t>& offsets, const vector<uint32_t>& targets, size_t n);
+};
+
+const size_t Snapshot::ELEMENT_SIZE[SECTION_COUNT] = {
+    sizeof(SnapshotRecord), sizeof(uint32_t), sizeof(uint32_t), sizeof(CourseIndex::Slot),
+    sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+    sizeof(uint64_t), sizeof(uint32_t), sizeof(char)
+};
+
+template<typename T>
+void Snapshot::put(string& image, SnapshotHeader& header, SnapshotSection section, const vector<T>& values) {
+    header.counts[section] = values.size();
+    if (!values.empty()) {
+        image.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+}
+
+// copy one section out of the mapping; the section sizes were checked
+template<typename T>
+void Snapshot::get(const char* (&cursor), const SnapshotHeader& header, SnapshotSection section, vector<T>& values) {
+    values.resize(header.counts[section]);
+    if (!values.empty()) {
+        std::memcpy(values.data(), cursor, values.size() * sizeof(T));
+        cursor += values.size() * sizeof(T);
+    }
+}
+
+bool Snapshot::validPositions(const vector<uint32_t>& values, size_t n) {
+    for (uint32_t value : values) {
+        if (value >= n) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Snapshot::validAdjacency(const vector<uint32_t>& offsets, const vector<uint32_t>& targets, size_t n) {
+    if (offsets.size() != n + 1 || offsets[0] != 0 || offsets[n] != targets.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (offsets[i] > offsets[i + 1]) {
+            return false;
+        }
+    }
+    return validPositions(targets, n);
+}
+
+/**
+ * Write the catalog and its indexes to path. The file is written next to
+ * path and renamed over it, so readers never see half a snapshot.
+ *
+ * @throw Error if the file cannot be written
+ */
+void Snapshot::save(const Catalog& catalog, const string& path) {
+    const vector<Course>& courses = catalog.courses;
+    const PrereqGraph& graph = *catalog.prereqs;
+
+    string heap;
+    unordered_map<std::string_view, uint32_t> ids; // course ids are written once
+    auto place = [&heap](std::string_view text) {
+        uint32_t offset = static_cast<uint32_t>(heap.size());
+        heap.append(text.data(), text.size());
+        return offset;
+    };
+
+    vector<SnapshotRecord> records(courses.size());
+    vector<uint32_t> nodes(courses.size());
+    for (size_t i = 0; i < courses.size(); ++i) {
+        const Course& course = courses[i];
+        SnapshotRecord& record = records[i];
+        nodes[i] = course.node;
+        auto id = ids.find(course.courseId);
+        record.idOffset = id != ids.end() ? id->second : (ids[course.courseId] = place(course.courseId));
+        record.idLength = static_cast<uint32_t>(course.courseId.size());
+        record.titleOffset = place(course.title);
+        record.titleLength = static_cast<uint32_t>(course.title.size());
+        record.prereqOffset = place(course.prerequisites);
+        record.prereqLength = static_cast<uint32_t>(course.prerequisites.size());
+        record.amount = course.amount;
+        if (heap.size() > UINT32_MAX) {
+            throw Error("snapshot text heap over 4GB");
+        }
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.recordSize = sizeof(SnapshotRecord);
+    header.closureWords = graph.words;
+    header.missing = graph.missing;
+    std::memcpy(header.schema, SNAPSHOT_SCHEMA, sizeof(SNAPSHOT_SCHEMA));
+
+    // the whole image in one buffer: one checksum pass, one write
+    string image(sizeof(header), '\0');
+    put(image, header, SECTION_RECORDS, records);
+    put(image, header, SECTION_BY_TITLE, catalog.byTitle.order);
+    put(image, header, SECTION_BY_COURSE_ID, catalog.byCourseId.order);
+    put(image, header, SECTION_ID_SLOTS, catalog.byId.slots);
+    put(image, header, SECTION_PREREQ_OFFSETS, graph.prereqOffsets);
+    put(image, header, SECTION_PREREQ_TARGETS, graph.prereqTargets);
+    put(image, header, SECTION_DEPEND_OFFSETS, graph.dependOffsets);
+    put(image, header, SECTION_DEPEND_TARGETS, graph.dependTargets);
+    put(image, header, SECTION_CYCLES, graph.cyclic);
+    put(image, header, SECTION_CLOSURE, graph.closure);
+    put(image, header, SECTION_NODES, nodes);
+    header.counts[SECTION_HEAP] = heap.size();
+    image.append(heap);
+    header.checksum = snapshotChecksum(image.data() + sizeof(header), image.size() - sizeof(header));
+    std::memcpy(&image[0], &header, sizeof(header));
+
+    string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), image.size());
+        if (!out.flush()) {
+            throw Error(string("Failed to write ").append(temp));
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        throw Error(string("Failed to replace ").append(path));
+    }
+}
+
+/**
+ * Map a snapshot and rebuild the catalog from it without parsing: the
+ * course text stays in the mapping, the indexes are copied as they are.
+ *
+ * @param catalog filled in only when the snapshot is valid
+ * @return false if the snapshot is missing, truncated, corrupted or
+ *         written by an incompatible version
+ */
+bool Snapshot::load(const string& path, Catalog& catalog) {
+    std::shared_ptr<const MappedFile> file;
+    try {
+        file = std::make_shared<const MappedFile>(path);
+    }
+    catch (Error&) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    if (file->size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SNAPSHOT_VERSION
+        || header.byteOrder != SNAPSHOT_BYTE_ORDER
+        || header.recordSize != sizeof(SnapshotRecord)
+        || std::memcmp(header.schema, SNAPSHOT_SCHEMA, sizeof(SNAPSHOT_SCHEMA)) != 0) {
+        return false;
+    }
+
+    // sizes come from the file, check them before trusting any of them
+    uint64_t body = file->size() - sizeof(header);
+    uint64_t expected = 0;
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        if (header.counts[section] > body / ELEMENT_SIZE[section]) {
+            return false;
+        }
+        expected += header.counts[section] * ELEMENT_SIZE[section];
+    }
+    const char* cursor = file->data() + sizeof(header);
+    if (expected != body || snapshotChecksum(cursor, body) != header.checksum) {
+        return false;
+    }
+
+    size_t n = header.counts[SECTION_RECORDS];
+    uint64_t heapSize = header.counts[SECTION_HEAP];
+    uint64_t slotCount = header.counts[SECTION_ID_SLOTS];
+    if (n >= UINT32_MAX || slotCount < 2 * n || (slotCount & (slotCount - 1)) != 0
+        || header.counts[SECTION_BY_TITLE] != n || header.counts[SECTION_BY_COURSE_ID] != n
+        || header.counts[SECTION_NODES] != n) {
+        return false;
+    }
+    // a closure, if kept, has one row of (n + 63) / 64 words per course;
+    // with n below 2^32 that is under 2^58 words, so n * words fits
+    const uint64_t closureWords = (uint64_t(n) + 63) / 64;
+    if (header.counts[SECTION_CLOSURE] != 0
+        && (header.closureWords != closureWords || header.counts[SECTION_CLOSURE] != n * closureWords)) {
+        return false;
+    }
+
+    Catalog loaded;
+    vector<SnapshotRecord> records;
+    vector<uint32_t> nodes;
+    std::shared_ptr<PrereqGraph> prereqs = std::make_shared<PrereqGraph>();
+    PrereqGraph& graph = *prereqs;
+    get(cursor, header, SECTION_RECORDS, records);
+    get(cursor, header, SECTION_BY_TITLE, loaded.byTitle.order);
+    get(cursor, header, SECTION_BY_COURSE_ID, loaded.byCourseId.order);
+    get(cursor, header, SECTION_ID_SLOTS, loaded.byId.slots);
+    get(cursor, header, SECTION_PREREQ_OFFSETS, graph.prereqOffsets);
+    get(cursor, header, SECTION_PREREQ_TARGETS, graph.prereqTargets);
+    get(cursor, header, SECTION_DEPEND_OFFSETS, graph.dependOffsets);
+    get(cursor, header, SECTION_DEPEND_TARGETS, graph.dependTargets);
+    get(cursor, header, SECTION_CYCLES, graph.cyclic);
+    get(cursor, header, SECTION_CLOSURE, graph.closure);
+    get(cursor, header, SECTION_NODES, nodes);
+    graph.words = static_cast<size_t>(closureWords);
+    graph.missing = header.missing;
+    const char* heap = cursor;
+
+    auto text = [heap, heapSize](uint32_t offset, uint32_t length, std::string_view& out) {
+        if (uint64_t(offset) + length > heapSize) {
+            return false;
+        }
+        out = std::string_view(heap + offset, length);
+        return true;
+    };
+    loaded.courses.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const SnapshotRecord& record = records[i];
+        Course& course = loaded.courses[i];
+        course.amount = record.amount;
+        course.node = nodes[i];
+        if (!text(record.idOffset, record.idLength, course.courseId)
+            || !text(record.titleOffset, record.titleLength, course.title)
+            || !text(record.prereqOffset, record.prereqLength, course.prerequisites)) {
+            return false;
+        }
+    }
+
+    CourseIndex& byId = loaded.byId;
+    byId.mask = slotCount != 0 ? slotCount - 1 : 0;
+    byId.count = 0;
+    for (const CourseIndex::Slot& slot : byId.slots) {
+        if (slot.position > n) {
+            return false;
+        }
+        byId.count += slot.position != 0;
+    }
+
+    if (!validPositions(loaded.byTitle.order, n) || !validPositions(loaded.byCourseId.order, n)
+        || !validPositions(graph.cyclic, n)
+        || !validAdjacency(graph.prereqOffsets, graph.prereqTargets, n)
+        || !validAdjacency(graph.dependOffsets, graph.dependTargets, n)
+        || !validPositions(nodes, n)) {
+        return false;
+    }
+
+    // every course its own vertex
+    loaded.nodePositions.assign(n, UINT32_MAX);
+    for (size_t i = 0; i < n; ++i) {
+        if (loaded.nodePositions[nodes[i]] != UINT32_MAX) {
+            return false;
+        }
+        loaded.nodePositions[nodes[i]] = static_cast<uint32_t>(i);
+    }
+    loaded.prereqs = std::move(prereqs);
+
+    loaded.image = std::move(file);
+    catalog = std::move(loaded);
+    return true;
+}
+
+/**
+ * Where the snapshot of a CSV file lives
+ */
+string snapshotPath(const string& csvPath) {
+    return csvPath + ".snap";
+}
+
+/**
+ * Load a catalog from the snapshot next to the CSV file, or from the
+ * CSV file itself when there is no usable snapshot or the CSV file or
+ * its change log (<csv>.log, see Parser::sync) is newer; a full CSV load
+ * writes a fresh snapshot.
+ *
+ * @param csvPath the path to the CSV file to load
+ * @return a catalog holding all the courses, already indexed
+ */
+Catalog openCatalog(const string& csvPath) {
+    string snapPath = snapshotPath(csvPath);
+    std::error_code snapError, csvError, logError;
+    auto snapTime = std::filesystem::last_write_time(snapPath, snapError);
+    auto csvTime = std::filesystem::last_write_time(csvPath, csvError);
+    auto logTime = std::filesystem::last_write_time(csvPath + ".log", logError);
+    if (!csvError && !logError && logTime > csvTime) {
+        csvTime = logTime; // edits appended since the snapshot are in the log only
+    }
+
+    if (!snapError) {
+        Catalog loaded;
+        if (!csvError && csvTime > snapTime) {
+            std::cout << "Snapshot " << snapPath << " is older than the CSV file, rebuilding" << endl;
+        }
+        else if (Snapshot::load(snapPath, loaded)) {
+            std::cout << "Loaded snapshot " << snapPath << endl;
+            return loaded;
+        }
+        else {
+            std::cout << "Snapshot " << snapPath << " is invalid, rebuilding" << endl;
+        }
+    }
+
+    bool complete = true;
+    Catalog loaded = loadCourses(csvPath, &complete);
+    if (complete && !csvError) {
+        try {
+            Snapshot::save(loaded, snapPath);
+        }
+        catch (Error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+    return loaded;
+}
+
+// FIXME (2a): Implement the quick sort logic over course.title
+
+/**
+ * Perform a quick sort on course title
+ * Average performance: O(n log(n))
+ * Worst case performance: O(n log(n)), introsort falls back to heapsort
+ *
+ * @param courses address of the vector<course> instance to be sorted
+ * @param begin the beginning index to sort on
+ * @param end the ending index to sort on
+ * @param threads 1 sorts on the calling thread, 0 uses every core
+ */
+void quickSort(vector<Course>& courses, int begin, int end, unsigned int threads = 1) {
+    CSV_SCOPE(QUICK_SORT);
+
+    /* Base case: If there are 1 or zero courses to sort,
+     partition is already sorted otherwise if begin is greater
+     than or equal to end then return*/
+    if (begin >= end) {
+
+        return;
+    }
+
+    introSort(courses.begin() + begin, courses.begin() + end + 1, [](const Course& a, const Course& b) {
+        return a.title < b.title;
+    }, threads);
+}
+
+// FIXME (1a): Implement the selection sort logic over course.title
+
+/**
+ * Perform a selection sort on course title
+ * Average performance: O(n^2))
+ * Worst case performance O(n^2))
+ *
+ * @param course address of the vector<course>
+ *            instance to be sorted
+ */
+void selectionSort(vector<Course>& courses) {
+    //define min as int (index of the current minimum course)
+
+    // check size of courses vector
+    // set size_t platform-neutral result equal to course.size()
+
+    // pos is the position within courses that divides sorted/unsorted
+    // for size_t pos = 0 and less than size -1 
+        // set min = pos
+        // loop over remaining elements to the right of position
+            // if this element's title is less than minimum title
+                // this element becomes the minimum
+        // swap the current minimum with smaller one found
+            // swap is a built in vector method
+
+    CSV_SCOPE(SELECTION_SORT);
+
+    //local variable declaration
+    int indexSmallest = 0;
+    Course tempSwap;
+
+    for (int i = 0; i < courses.size() - 1; i++) {
+
+        indexSmallest = i;
+
+        for (int j = i + 1; j < courses.size(); j++) {
+
+            if (courses[j].title < courses[indexSmallest].title) {
+                indexSmallest = j;
+            }
+        }
+
+        CSV_COUNT(SORT_COMPARISONS, courses.size() - i - 1);
+        CSV_COUNT(SORT_SWAPS, 1);
+
+        //swap the vector positions using a tempSwap variable of type course
+        tempSwap = courses[i];
+        courses[i] = courses[indexSmallest];
+        courses[indexSmallest] = tempSwap;
+
+    }
+}
+
+/**
+ * Simple C function to convert a string to a double
+ * after stripping out unwanted char
+ * No allocation and no locale, unlike the original erase + atof
+ *
+ * credit: http://stackoverflow.com/a/24875936
+ *
+ * @param ch The character to strip out
+ */
+double strToDouble(std::string_view str, char ch) {
+    char buffer[64];
+    std::string copy;
+    char* out = buffer;
+
+    // strip ch into a stack buffer, the heap only for very long values
+    if (str.size() > sizeof(buffer)) {
+        copy.resize(str.size());
+        out = &copy[0];
+    }
+    size_t n = 0;
+    for (char c : str) {
+        if (c != ch) {
+            out[n++] = c;
+        }
+    }
+
+    double value = 0.0;
+    if (!convertField(std::string_view(out, n), value)) {
+        return 0.0;
+    }
+    return value;
+}
+
+/**
+ * Pause the menu so the user can read the output
+ */
+void sleepFor(int milliseconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+/**
+ * Clear the console before the menu is drawn again
+ */
+void clearScreen() {
+#ifdef _WIN32
+    system("cls");
+#else
+    std::cout << "\033[2J\033[H" << std::flush;
+#endif
+}
+
+// swallows std::cout for its lifetime, e.g. load progress in the machine-readable modes
+class QuietConsole {
+public:
+    QuietConsole() {
+        saved = std::cout.rdbuf(nullptr);
+    }
+    ~QuietConsole() {
+        std::cout.rdbuf(saved);
+        std::cout.clear();
+    }
+
+private:
+    std::streambuf* saved;
+};
+
+//============================================================================
+// Reports, run with --report; see reportMain for the options
+//============================================================================
+
+// formats courses into one large block and hands it to the stream whole,
+// so a report costs a few big writes instead of one flush per line
+class ReportWriter {
+public:
+    enum Format { eTEXT, eCSV, eJSON_LINES };
+    enum Field { eCOURSE_ID, eTITLE, eAMOUNT, ePREREQUISITES };
+
+    ReportWriter(std::ostream& out, Format format = eTEXT, vector<Field> fields = {});
+    ~ReportWriter();
+
+    void write(const Course& course);
+    template<typename Positions>
+    size_t write(const vector<Course>& courses, const Positions& positions, size_t offset = 0, size_t limit = SIZE_MAX);
+    size_t writeAll(const vector<Course>& courses, size_t offset = 0, size_t limit = SIZE_MAX);
+    void flush();
+
+    static bool parseFormat(const string& name, Format& format);
+    static bool parseFields(const string& list, vector<Field>& fields);
+
+private:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    void appendField(Field field, const Course& course);
+    void appendCsv(std::string_view value);
+    void appendJson(std::string_view value);
+
+    std::ostream& out;
+    Format format;
+    vector<Field> fields;
+    string block;
+    bool started = false; // the CSV header is written before the first course
+};
+
+/**
+ * @param out where the report goes, e.g. std::cout or an ofstream
+ * @param format text lines like displayCourse, CSV with a header, or one JSON object per line
+ * @param fields the fields to write, in order; empty for every field, in
+ *               displayCourse order for text and file order for CSV and JSON
+ */
+ReportWriter::ReportWriter(std::ostream& out, Format format, vector<Field> fields)
+    : out(out), format(format), fields(std::move(fields)) {
+    if (this->fields.empty()) {
+        this->fields = format == eTEXT
+            ? vector<Field>{ eTITLE, eCOURSE_ID, eAMOUNT, ePREREQUISITES }
+            : vector<Field>{ eCOURSE_ID, eTITLE, ePREREQUISITES, eAMOUNT };
+    }
+    block.reserve(BLOCK_SIZE + 4096);
+}
+
+ReportWriter::~ReportWriter() {
+    try {
+        flush();
+    }
+    catch (...) {
+    }
+}
+
+/**
+ * Format one course; the block goes out once it is full
+ */
+void ReportWriter::write(const Course& course) {
+    static const char* const names[] = { "courseId", "title", "amount", "prerequisites" };
+
+    if (format == eCSV && !started) {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            block.append(i == 0 ? "" : ",").append(names[fields[i]]);
+        }
+        block.append(1, '\n');
+    }
+    started = true;
+
+    // text: the first field, then ": " and the rest separated by " | "
+    for (size_t i = 0; i < fields.size(); ++i) {
+        switch (format) {
+        case eTEXT:
+            block.append(i == 0 ? "" : i == 1 ? ": " : " | ");
+            break;
+        case eCSV:
+            block.append(i == 0 ? "" : ",");
+            break;
+        case eJSON_LINES:
+            block.append(i == 0 ? "{\"" : ",\"").append(names[fields[i]]).append("\":");
+            break;
+        }
+        appendField(fields[i], course);
+    }
+    block.append(format == eJSON_LINES ? "}\n" : "\n");
+
+    if (block.size() >= BLOCK_SIZE) {
+        flush();
+    }
+}
+
+/**
+ * Write one page of courses
+ *
+ * @param courses the catalog courses
+ * @param positions the courses to write, in order, e.g. an index or a prefix range
+ * @param offset how many of them to skip
+ * @param limit the most to write
+ * @return the number written
+ */
+template<typename Positions>
+size_t ReportWriter::write(const vector<Course>& courses, const Positions& positions, size_t offset, size_t limit) {
+    size_t written = 0;
+    for (uint32_t pos : positions) {
+        if (written == limit) {
+            break;
+        }
+        if (offset > 0) {
+            --offset;
+            continue;
+        }
+        write(courses[pos]);
+        ++written;
+    }
+    return written;
+}
+
+/**
+ * Write one page of courses in catalog order
+ *
+ * @return the number written
+ */
+size_t ReportWriter::writeAll(const vector<Course>& courses, size_t offset, size_t limit) {
+    size_t first = std::min(offset, courses.size());
+    size_t last = first + std::min(limit, courses.size() - first);
+    for (size_t i = first; i < last; ++i) {
+        write(courses[i]);
+    }
+    return last - first;
+}
+
+/**
+ * Hand what is formatted to the stream in one piece, and flush it
+ */
+void ReportWriter::flush() {
+    if (!block.empty()) {
+        out.write(block.data(), block.size());
+        block.clear();
+    }
+    out.flush();
+}
+
+// text, csv or jsonl
+bool ReportWriter::parseFormat(const string& name, Format& format) {
+    if (name == "text") {
+        format = eTEXT;
+    }
+    else if (name == "csv") {
+        format = eCSV;
+    }
+    else if (name == "jsonl") {
+        format = eJSON_LINES;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// a comma separated list of courseId, title, amount and prerequisites
+bool ReportWriter::parseFields(const string& list, vector<Field>& fields) {
+    fields.clear();
+    std::stringstream names(list);
+    for (string name; std::getline(names, name, ',');) {
+        if (name == "courseId") {
+            fields.push_back(eCOURSE_ID);
+        }
+        else if (name == "title") {
+            fields.push_back(eTITLE);
+        }
+        else if (name == "amount") {
+            fields.push_back(eAMOUNT);
+        }
+        else if (name == "prerequisites") {
+            fields.push_back(ePREREQUISITES);
+        }
+        else {
+            return false;
+        }
+    }
+    return !fields.empty();
+}
+
+void ReportWriter::appendField(Field field, const Course& course) {
+    if (field == eAMOUNT) {
+        // same digits as std::cout << course.amount
+        char amount[32];
+        std::to_chars_result end = std::to_chars(amount, amount + sizeof(amount), course.amount, std::chars_format::general, 6);
+        block.append(amount, end.ptr);
+        return;
+    }
+    std::string_view value = field == eCOURSE_ID ? course.courseId
+        : field == eTITLE ? course.title
+        : course.prerequisites;
+    switch (format) {
+    case eTEXT:
+        block.append(value.data(), value.size());
+        break;
+    case eCSV:
+        appendCsv(value);
+        break;
+    case eJSON_LINES:
+        appendJson(value);
+        break;
+    }
+}
+
+// quoted only when it has to be, quotes doubled
+void ReportWriter::appendCsv(std::string_view value) {
+    if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+        block.append(value.data(), value.size());
+        return;
+    }
+    block.append(1, '"');
+    for (char c : value) {
+        if (c == '"') {
+            block.append(1, '"');
+        }
+        block.append(1, c);
+    }
+    block.append(1, '"');
+}
+
+// a JSON string; bytes over 0x7f are passed through as they are
+void ReportWriter::appendJson(std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    block.append(1, '"');
+    size_t plain = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        block.append(value.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+        case '"': block.append("\\\""); break;
+        case '\\': block.append("\\\\"); break;
+        case '\n': block.append("\\n"); break;
+        case '\r': block.append("\\r"); break;
+        case '\t': block.append("\\t"); break;
+        default:
+            block.append("\\u00").append(1, hex[c >> 4]).append(1, hex[c & 15]);
+        }
+    }
+    block.append(value.data() + plain, value.size() - plain);
+    block.append(1, '"');
+}
+
+/**
+ * ProjectTwo --report <csv> [--format text|csv|jsonl] [--fields courseId,title,...]
+ *                           [--offset N] [--limit N] [--page N --page-size N]
+ *                           [--order file|title|courseId] [--out file]
+ *
+ * Loads the catalog, from its snapshot when current, and writes the
+ * courses to stdout or the --out file. --page counts from 0.
+ */
+int reportMain(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: --report <csv> [options]" << endl;
+        return 1;
+    }
+    string csvPath = argv[2];
+    ReportWriter::Format format = ReportWriter::eTEXT;
+    vector<ReportWriter::Field> fields;
+    uint64_t offset = 0, limit = SIZE_MAX, page = 0, pageSize = 0;
+    string order = "file", outPath;
+
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        bool good = true;
+        if (arg == "--format") {
+            good = ReportWriter::parseFormat(value, format);
+        }
+        else if (arg == "--fields") {
+            good = ReportWriter::parseFields(value, fields);
+        }
+        else if (arg == "--offset") {
+            good = convertField(value, offset);
+        }
+        else if (arg == "--limit") {
+            good = convertField(value, limit);
+        }
+        else if (arg == "--page") {
+            good = convertField(value, page);
+        }
+        else if (arg == "--page-size") {
+            good = convertField(value, pageSize) && pageSize > 0;
+        }
+        else if (arg == "--order") {
+            order = value;
+            good = order == "file" || order == "title" || order == "courseId";
+        }
+        else if (arg == "--out") {
+            outPath = value;
+        }
+        else {
+            std::cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+        if (!good) {
+            std::cerr << "bad value " << value << " for " << arg << endl;
+            return 1;
+        }
+    }
+    if (pageSize > 0) {
+        offset = page * pageSize;
+        limit = pageSize;
+    }
+
+    try {
+        std::shared_ptr<const Catalog> current;
+        {
+            QuietConsole quiet;
+            catalog.publish(openCatalog(csvPath));
+            current = catalog.current();
+        }
+
+        std::ofstream file;
+        if (!outPath.empty()) {
+            file.open(outPath, std::ios::binary);
+            if (!file) {
+                throw Error(string("can't write ").append(outPath));
+            }
+        }
+        ReportWriter report(outPath.empty() ? std::cout : file, format, fields);
+        if (order == "file") {
+            report.writeAll(current->courses, offset, limit);
+        }
+        else {
+            const SortedIndex& index = order == "title" ? current->byTitle : current->byCourseId;
+            report.write(current->courses, index.prefix(current->courses, ""), offset, limit);
+        }
+        report.flush();
+        if (!(outPath.empty() ? std::cout : file)) {
+            throw Error(string("can't write ").append(outPath.empty() ? "the report" : outPath));
+        }
+    }
+    catch (Error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * ProjectTwo --sort <csv> [--by title,courseId] [--memory 64M] [--temp dir] [--out file]
+ *
+ * Sorts a catalog file too large to load, by one or more columns, most
+ * significant first (title by default), using at most about --memory
+ * bytes (K, M or G suffix) plus one read block. The sorted file goes to
+ * stdout or replaces --out once complete.
+ */
+int sortMain(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: --sort <csv> [options]" << endl;
+        return 1;
+    }
+    string csvPath = argv[2];
+    vector<string> keys{ "title" };
+    uint64_t memory = 64 << 20;
+    string tempDir, outPath;
+
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        bool good = true;
+        if (arg == "--by") {
+            keys.clear();
+            std::stringstream list(value);
+            for (string key; std::getline(list, key, ',');) {
+                good = good && !key.empty();
+                keys.push_back(key);
+            }
+        }
+        else if (arg == "--memory") {
+            uint64_t scale = 1;
+            string number = value;
+            char unit = value.empty() ? 0 : static_cast<char>(toupper(static_cast<unsigned char>(value.back())));
+            if (unit == 'K' || unit == 'M' || unit == 'G') {
+                scale = unit == 'K' ? 1 << 10 : unit == 'M' ? 1 << 20 : 1 << 30;
+                number.pop_back();
+            }
+            // checked before scaling, so a huge count can't wrap around to a small budget
+            good = convertField(number, memory) && memory > 0 && memory <= SIZE_MAX / scale;
+            memory *= scale;
+        }
+        else if (arg == "--temp") {
+            tempDir = value;
+        }
+        else if (arg == "--out") {
+            outPath = value;
+        }
+        else {
+            std::cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+        if (!good) {
+            std::cerr << "bad value " << value << " for " << arg << endl;
+            return 1;
+        }
+    }
+
+    try {
+        ExternalSort sorter(csvPath, keys, static_cast<size_t>(memory));
+        if (!tempDir.empty()) {
+            sorter.setTempDirectory(tempDir);
+        }
+        if (outPath.empty()) {
+            sorter.sort(std::cout);
+            std::cout.flush();
+        }
+        else {
+            sorter.sort(outPath);
+        }
+    }
+    catch (Error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+//============================================================================
+// Benchmark, run with --bench; see benchMain for the options. Standard
+// C++ only (chrono, random), so it runs the same on Windows and elsewhere
+//============================================================================
+
+// what to measure and how often
+struct BenchOptions {
+    vector<size_t> sizes{ 1000, 10000, 100000, 1000000 };
+    int warmup = 1;          // untimed runs before the samples
+    int reps = 5;            // timed runs per benchmark
+    size_t selectionMax = 10000; // selection sort is O(n^2), skipped above this
+    size_t lookups = 100000; // SearchCourse calls per sample
+    uint64_t seed = 42;
+    bool json = false;       // JSON lines instead of CSV
+    string out;              // results file, stdout if empty
+};
+
+/**
+ * Write a synthetic catalog as CSV: ids spread over departments, titles
+ * from a small vocabulary, and 0-4 prerequisites per course drawn from
+ * the courses before it, mostly close ones, so the graph is a DAG with
+ * a realistic fan-out of about 1.2
+ *
+ * @param path the CSV file to write
+ * @param count number of courses
+ * @param seed the same seed always gives the same catalog
+ */
+void writeSyntheticCatalog(const string& path, size_t count, uint64_t seed) {
+    static const char* const departments[] = { "CSCI", "MATH", "PHYS", "CHEM", "BIOL", "ENGL", "HIST", "ECON", "PSYC", "ARTS" };
+    static const char* const levels[] = { "Introduction to", "Foundations of", "Topics in", "Applied", "Advanced", "Seminar in" };
+    static const char* const topics[] = { "Programming", "Data Structures", "Algorithms", "Calculus", "Linear Algebra",
+        "Mechanics", "Organic Chemistry", "Genetics", "Composition", "World History", "Microeconomics", "Cognition",
+        "Operating Systems", "Databases", "Statistics", "Drawing" };
+    static const int fanOut[] = { 35, 30, 20, 10, 5 }; // percent of courses with 0, 1, 2, 3, 4 prerequisites
+
+    std::mt19937_64 rng(seed);
+    auto id = [](size_t i) {
+        return string(departments[i % 10]).append(std::to_string(100 + i / 10));
+    };
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    string block = "courseId,title,prerequisites\n";
+    vector<size_t> picked;
+
+    for (size_t i = 0; i < count; ++i) {
+        block.append(id(i)).append(",");
+        block.append(levels[rng() % 6]).append(" ").append(topics[rng() % 16]);
+        block.append(" ").append(std::to_string(i % 997)).append(",");
+
+        int roll = static_cast<int>(rng() % 100);
+        size_t k = 0;
+        while (k < 4 && roll >= fanOut[k]) {
+            roll -= fanOut[k++];
+        }
+        picked.clear();
+        std::geometric_distribution<size_t> distance(0.05);
+        for (size_t j = 0; j < k && i > 0; ++j) {
+            size_t prereq = i - 1 - std::min(distance(rng), i - 1);
+            if (std::find(picked.begin(), picked.end(), prereq) == picked.end()) {
+                picked.push_back(prereq);
+            }
+        }
+        if (picked.size() > 1) {
+            block.append("\"");
+        }
+        for (size_t j = 0; j < picked.size(); ++j) {
+            block.append(j ? " " : "").append(id(picked[j]));
+        }
+        if (picked.size() > 1) {
+            block.append("\"");
+        }
+        block.append("\n");
+
+        if (block.size() >= (1 << 20)) {
+            file.write(block.data(), block.size());
+            block.clear();
+        }
+    }
+    file.write(block.data(), block.size());
+    if (!file.flush()) {
+        throw Error(string("Failed to write ").append(path));
+    }
+}
+
+// results stored here cannot be optimized away
+volatile size_t benchSink;
+
+// timing summary of one benchmark
+struct BenchResult {
+    string name;
+    size_t courses;
+    size_t ops;     // operations per sample
+    vector<double> samples; // milliseconds
+};
+
+/**
+ * Time fn: warmup untimed runs, then reps timed ones. setup runs before
+ * every call and is not timed.
+ */
+template<typename Setup, typename Fn>
+vector<double> measure(const BenchOptions& options, Setup setup, Fn fn) {
+    vector<double> samples;
+    for (int i = 0; i < options.warmup + options.reps; ++i) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto stop = std::chrono::steady_clock::now();
+        if (i >= options.warmup) {
+            samples.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+    }
+    return samples;
+}
+
+/**
+ * Nearest-rank percentile of sorted samples
+ */
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+/**
+ * One result as a CSV row or a JSON line
+ */
+void writeResult(std::ostream& out, const BenchResult& result, bool json) {
+    vector<double> sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (double sample : sorted) {
+        mean += sample / sorted.size();
+    }
+    const char* names[] = { "min_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms", "mean_ms" };
+    double values[] = { sorted.front(), percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.back(), mean };
+
+    out << std::setprecision(6);
+    if (json) {
+        out << "{\"benchmark\":\"" << result.name << "\",\"courses\":" << result.courses
+            << ",\"reps\":" << sorted.size() << ",\"ops\":" << result.ops;
+        for (int i = 0; i < 6; ++i) {
+            out << ",\"" << names[i] << "\":" << values[i];
         }
+        out << "}\n";
     }
-    catch (Error& e) {
-        std::cerr << e.what() << std::endl;
+    else {
+        out << result.name << "," << result.courses << "," << sorted.size() << "," << result.ops;
+        for (int i = 0; i < 6; ++i) {
+            out << "," << values[i];
+        }
+        out << "\n";
     }
-    return courses;
 }
 
-// FIXME (2a): Implement the quick sort logic over course.title
-
 /**
- * Partition the vector of courses into two parts, low and high
- *
- * @param courses Address of the vector<course> instance to be partitioned
- * @param begin Beginning index to partition
- * @param end Ending index to partition
+ * Generate a catalog of every size and time loadCourses, quickSort,
+ * selectionSort and SearchCourse on it
  */
-int partition(vector<Course>& courses, int begin, int end) {
-    //set low and high equal to begin and end
-
-    // pick the middle element as pivot point
-
-    // while not done 
-
-        // keep incrementing low index while courses[low] < courses[pivot]
-
-        // keep decrementing high index while courses[pivot] < courses[high]
-
-        /* If there are zero or one elements remaining,
-            all courses are partitioned. Return high */
-            // else swap the low and high courses (built in vector method)
-                 // move low and high closer ++low, --high
-         //return high;
-
-
-         //local variable declaration
-    int midPoint;
-    string pivot;
-    Course tempSwap;
-    bool done;
+void runBenchmarks(const BenchOptions& options, std::ostream& out) {
+    if (!options.json) {
+        out << "benchmark,courses,reps,ops,min_ms,p50_ms,p90_ms,p99_ms,max_ms,mean_ms\n";
+    }
 
-    midPoint = begin + (end - begin) / 2;
-    pivot = courses[midPoint].title;
-    done = false;
+    for (size_t n : options.sizes) {
+        std::cerr << "generating " << n << " courses" << endl;
+        string path = (std::filesystem::temp_directory_path() / ("cs300_bench_" + std::to_string(n) + ".csv")).string();
+        writeSyntheticCatalog(path, n, options.seed);
 
-    while (!done) {
+        vector<BenchResult> results;
+        Catalog loaded;
 
-        while (courses[begin].title < pivot) {
+        // keep the "Loading CSV file" lines out of the results
+        {
+            QuietConsole quiet;
+            results.push_back({ "loadCourses", n, 1, measure(options, [&loaded]() { loaded = Catalog(); }, [&]() {
+                loaded = loadCourses(path);
+            }) });
+        }
 
-            begin++;
+        // sorts start from the file order every time
+        vector<Course> courses;
+        results.push_back({ "quickSort", n, 1, measure(options, [&]() { courses = loaded.courses; }, [&]() {
+            quickSort(courses, 0, static_cast<int>(courses.size()) - 1);
+        }) });
+        if (n <= options.selectionMax) {
+            results.push_back({ "selectionSort", n, 1, measure(options, [&]() { courses = loaded.courses; }, [&]() {
+                selectionSort(courses);
+            }) });
         }
 
-        while (pivot < courses[end].title) {
+        // a fixed mix of ids, one in ten missing
+        vector<string> ids;
+        std::mt19937_64 rng(options.seed);
+        for (size_t i = 0; i < options.lookups; ++i) {
+            ids.push_back(rng() % 10 == 0 ? "NONE" + std::to_string(i) : string(loaded.courses[rng() % n].courseId));
+        }
+        catalog.publish(loaded);
+        results.push_back({ "SearchCourse", n, ids.size(), measure(options, []() {}, [&]() {
+            size_t hits = 0;
+            for (const string& id : ids) {
+                hits += SearchCourse(id) != nullptr;
+            }
+            benchSink = hits;
+        }) });
+
+        // the same ids with one typo each: a character dropped, doubled or lower cased
+        vector<string> noisy;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            string id = ids[i];
+            size_t at = rng() % id.size();
+            switch (i % 3) {
+            case 0: id.erase(at, 1); break;
+            case 1: id.insert(at, 1, id[at]); break;
+            default: id[at] = static_cast<char>(std::tolower(static_cast<unsigned char>(id[at]))); break;
+            }
+            noisy.push_back(id);
+        }
+        results.push_back({ "FuzzyIndex::build", n, 1, measure(options, []() {}, [&]() {
+            FuzzyIndex index;
+            index.build(loaded.courses);
+        }) });
+        const FuzzyIndex& fuzzy = catalog.current()->fuzzyIndex();
+        results.push_back({ "FuzzyIndex::search", n, noisy.size(), measure(options, []() {}, [&]() {
+            size_t hits = 0;
+            for (const string& id : noisy) {
+                hits += fuzzy.search(loaded.courses, id, 10).size();
+            }
+            benchSink = hits;
+        }) });
+
+        // keyword searches, one word and two, on the synthetic title words
+        static const char* const queries[] = { "algorithms", "introduction programming", "advanced linear algebra",
+            "topics statistics", "seminar 42", "applied genetics" };
+        results.push_back({ "TitleIndex::build", n, 1, measure(options, []() {}, [&]() {
+            TitleIndex index;
+            index.build(loaded.courses);
+        }) });
+        const TitleIndex& titles = catalog.current()->titleIndex();
+        results.push_back({ "TitleIndex::search", n, 6, measure(options, []() {}, [&]() {
+            size_t hits = 0;
+            for (const char* query : queries) {
+                hits += titles.search(query, TitleIndex::eALL_WORDS, 10).size();
+            }
+            benchSink = hits;
+        }) });
+        results.push_back({ "TitleIndex::searchAny", n, 6, measure(options, []() {}, [&]() {
+            size_t hits = 0;
+            for (const char* query : queries) {
+                hits += titles.search(query, TitleIndex::eANY_WORD, 10).size();
+            }
+            benchSink = hits;
+        }) });
+        catalog.publish(Catalog());
 
-            end--;
+        for (const BenchResult& result : results) {
+            writeResult(out, result, options.json);
         }
+        out.flush();
 
-        if (begin >= end) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
 
-            done = true;
+/**
+ * ProjectTwo --bench [--sizes 1000,10000] [--max N] [--reps N] [--warmup N]
+ *                    [--selection-max N] [--lookups N] [--seed N] [--json] [--out file]
+ *
+ * --max N runs every power of ten from 10^3 to N, e.g. --max 10000000
+ */
+int benchMain(int argc, char* argv[]) {
+    BenchOptions options;
+
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        string value = hasValue ? argv[i + 1] : "";
+        uint64_t number = 0;
+        // a numeric option's value has to parse and lie in [least, most]
+        auto bad = [&value, &number](uint64_t least, uint64_t most) {
+            return !convertField(value, number) || number < least || number > most;
+        };
+
+        if (arg == "--json") {
+            options.json = true;
+            continue;
+        }
+        if (!hasValue) {
+            std::cerr << "missing value for " << arg << endl;
+            return 1;
+        }
+        ++i;
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            std::stringstream list(value);
+            for (string size; std::getline(list, size, ',');) {
+                uint64_t count = 0;
+                if (!convertField(size, count) || count == 0) {
+                    std::cerr << "bad size " << size << endl;
+                    return 1;
+                }
+                options.sizes.push_back(count);
+            }
+        }
+        else if (arg == "--max") {
+            // the sizes run 1000, 10000, ... up to max
+            if (bad(1000, UINT32_MAX)) {
+                std::cerr << "bad max " << value << endl;
+                return 1;
+            }
+            options.sizes.clear();
+            for (size_t size = 1000; size <= number; size *= 10) {
+                options.sizes.push_back(size);
+            }
+        }
+        else if (arg == "--reps") {
+            if (bad(1, INT_MAX)) {
+                std::cerr << "bad reps " << value << endl;
+                return 1;
+            }
+            options.reps = static_cast<int>(number);
+        }
+        else if (arg == "--warmup") {
+            if (bad(0, INT_MAX)) {
+                std::cerr << "bad warmup " << value << endl;
+                return 1;
+            }
+            options.warmup = static_cast<int>(number);
+        }
+        else if (arg == "--selection-max") {
+            if (bad(0, SIZE_MAX)) {
+                std::cerr << "bad selection max " << value << endl;
+                return 1;
+            }
+            options.selectionMax = number;
+        }
+        else if (arg == "--lookups") {
+            if (bad(1, SIZE_MAX)) {
+                std::cerr << "bad lookups " << value << endl;
+                return 1;
+            }
+            options.lookups = number;
+        }
+        else if (arg == "--seed") {
+            if (bad(0, UINT64_MAX)) {
+                std::cerr << "bad seed " << value << endl;
+                return 1;
+            }
+            options.seed = number;
+        }
+        else if (arg == "--out") {
+            options.out = value;
         }
-
         else {
+            std::cerr << "unknown option " << arg << endl;
+            return 1;
+        }
+    }
 
-            //set-up the swaps using a tempSwap variable of type course
-            tempSwap = courses[begin];
-            courses[begin] = courses[end];
-            courses[end] = tempSwap;
-
-            begin++;
-            end--;
+    try {
+        if (options.out.empty()) {
+            runBenchmarks(options, std::cout);
+        }
+        else {
+            std::ofstream out(options.out);
+            runBenchmarks(options, out);
         }
     }
+    catch (Error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
+//============================================================================
+// Batch mode, run with --batch; see batchMain for the commands
+//============================================================================
 
-    return end;
+/**
+ * Append one course as a tab separated line: id, title, amount, prerequisites
+ */
+void appendCourse(string& out, const Course& course) {
+    char amount[32];
+    std::to_chars_result end = std::to_chars(amount, amount + sizeof(amount), course.amount);
+    out.append(course.courseId).append(1, '\t').append(course.title).append(1, '\t');
+    out.append(amount, end.ptr).append(1, '\t').append(course.prerequisites).append(1, '\n');
 }
 
 /**
- * Perform a quick sort on course title
- * Average performance: O(n log(n))
- * Worst case performance O(n^2))
+ * Run one batch command against the global catalog
  *
- * @param courses address of the vector<course> instance to be sorted
- * @param begin the beginning index to sort on
- * @param end the ending index to sort on
+ * @param line the command, e.g. "find CSCI200"
+ * @param out where the results go
+ * @return false if the command failed; the reason is already in out
  */
-void quickSort(vector<Course>& courses, int begin, int end) {
-    //set mid equal to 0
-
-    /* Base case: If there are 1 or zero courses to sort,
-     partition is already sorted otherwise if begin is greater
-     than or equal to end then return*/
-
-     /* Partition courses into low and high such that
-      midpoint is location of last element in low */
-
-      // recursively sort low partition (begin to mid)
-
-      // recursively sort high partition (mid+1 to end)
-
-    int lowIndex;
-
-    if (begin >= end) {
-
-        return;
+bool runCommand(const string& line, string& out) {
+    std::istringstream words(line);
+    string command, argument, option;
+    words >> command >> std::ws;
+    std::getline(words, argument);
+    const string text = argument; // everything after the command, spaces included
+    string fieldList;
+    std::istringstream(argument) >> argument >> option >> fieldList;
+
+    if (command == "load") {
+        if (argument.empty()) {
+            out.append("error: load needs a CSV path\n");
+            return false;
+        }
+        {
+            QuietConsole quiet;
+            catalog.publish(openCatalog(argument));
+        }
+        out.append("loaded ").append(std::to_string(catalog.current()->courses.size())).append(" courses\n");
     }
-
-    //call the partition function to define the lowIndex
-    lowIndex = partition(courses, begin, end);
-
-    //recursive calls to quickSort
-    quickSort(courses, begin, lowIndex);
-    quickSort(courses, lowIndex + 1, end);
-
+    else if (command == "reload") {
+        if (argument.empty()) {
+            out.append("error: reload needs a CSV path\n");
+            return false;
+        }
+        ChangeSet changes;
+        catalog.update([&argument, &changes](Catalog& next) {
+            return reloadCourses(next, argument, changes);
+        });
+        for (const string& id : changes.added) {
+            out.append("+\t").append(id).append(1, '\n');
+        }
+        for (const string& id : changes.updated) {
+            out.append("~\t").append(id).append(1, '\n');
+        }
+        for (const string& id : changes.removed) {
+            out.append("-\t").append(id).append(1, '\n');
+        }
+        out.append("reloaded ").append(std::to_string(changes.added.size())).append(" added ");
+        out.append(std::to_string(changes.updated.size())).append(" updated ");
+        out.append(std::to_string(changes.removed.size())).append(" removed\n");
+    }
+    else if (command == "export") {
+        // export <file> [text|csv|jsonl] [fields]
+        ReportWriter::Format format = ReportWriter::eTEXT;
+        vector<ReportWriter::Field> fields;
+        if (argument.empty()) {
+            out.append("error: export needs a file path\n");
+            return false;
+        }
+        if (!option.empty() && !ReportWriter::parseFormat(option, format)) {
+            out.append("error: unknown format ").append(option).append(1, '\n');
+            return false;
+        }
+        if (!fieldList.empty() && !ReportWriter::parseFields(fieldList, fields)) {
+            out.append("error: unknown fields ").append(fieldList).append(1, '\n');
+            return false;
+        }
+        std::shared_ptr<const Catalog> current = catalog.current();
+        std::ofstream file(argument, std::ios::binary);
+        size_t written;
+        {
+            ReportWriter report(file, format, fields);
+            written = report.writeAll(current->courses);
+        }
+        if (!file) {
+            out.append("error: can't write ").append(argument).append(1, '\n');
+            return false;
+        }
+        out.append("exported ").append(std::to_string(written)).append(" courses\n");
+    }
+    else if (command == "save") {
+        if (argument.empty()) {
+            out.append("error: save needs a snapshot path\n");
+            return false;
+        }
+        std::shared_ptr<const Catalog> current = catalog.current();
+        Snapshot::save(*current, argument);
+        out.append("saved ").append(std::to_string(current->courses.size())).append(" courses\n");
+    }
+    else if (command == "sort") {
+        // sort title|courseId [key|quick|selection]
+        std::string_view Course::* key = argument == "courseId" ? &Course::courseId : &Course::title;
+        if (argument != "title" && argument != "courseId") {
+            out.append("error: sort by title or courseId\n");
+            return false;
+        }
+        if (!option.empty() && option != "key" && !((option == "quick" || option == "selection") && argument == "title")) {
+            out.append("error: unknown sort ").append(option).append(" for ").append(argument).append(1, '\n');
+            return false;
+        }
+        // the sorted copy becomes the next generation
+        catalog.update([&option, key](Catalog& next) {
+            if (option == "quick") {
+                quickSort(next.courses, 0, static_cast<int>(next.courses.size()) - 1, 0);
+            }
+            else if (option == "selection" && !next.courses.empty()) {
+                selectionSort(next.courses);
+            }
+            else {
+                keySort(next.courses, key, 0);
+            }
+            next.reorder();
+        });
+        out.append("sorted ").append(std::to_string(catalog.current()->courses.size())).append(" courses\n");
+    }
+    else if (command == "fuzzy") {
+        // closest ids and titles first, each line led by its score and what matched
+        std::shared_ptr<const Catalog> current = catalog.current();
+        for (const FuzzyMatch& match : current->fuzzyIndex().search(current->courses, text)) {
+            char score[32];
+            std::to_chars_result end = std::to_chars(score, score + sizeof(score), match.score, std::chars_format::fixed, 3);
+            out.append(score, end.ptr).append(match.byTitle ? "\ttitle\t" : "\tid\t");
+            appendCourse(out, current->courses[match.course]);
+        }
+        out.append("end\n");
+    }
+    else if (command == "search" || command == "search-any") {
+        // best titles first, each line led by its score
+        std::shared_ptr<const Catalog> current = catalog.current();
+        TitleIndex::Match match = command == "search" ? TitleIndex::eALL_WORDS : TitleIndex::eANY_WORD;
+        for (const TitleMatch& hit : current->titleIndex().search(text, match)) {
+            char score[32];
+            std::to_chars_result end = std::to_chars(score, score + sizeof(score), hit.score, std::chars_format::fixed, 3);
+            out.append(score, end.ptr).append(1, '\t');
+            appendCourse(out, current->courses[hit.course]);
+        }
+        out.append("end\n");
+    }
+    else if (command == "find" || command == "prereqs") {
+        std::shared_ptr<const Catalog> current = catalog.current();
+        const Course* found = SearchCourse(*current, argument);
+        if (found == nullptr) {
+            out.append("not found ").append(argument).append(1, '\n');
+            return true;
+        }
+        if (command == "find") {
+            appendCourse(out, *found);
+            return true;
+        }
+        // every course needed before this one, direct or not
+        uint32_t pos = static_cast<uint32_t>(found - current->courses.data());
+        for (uint32_t p : current->prerequisitesOf(pos)) {
+            appendCourse(out, current->courses[p]);
+        }
+        out.append("end\n");
+    }
+    else if (command == "prefix") {
+        std::shared_ptr<const Catalog> current = catalog.current();
+        for (uint32_t pos : current->byCourseId.prefix(current->courses, argument)) {
+            appendCourse(out, current->courses[pos]);
+        }
+        out.append("end\n");
+    }
+    else if (command == "list") {
+        std::shared_ptr<const Catalog> current = catalog.current();
+        for (const Course& course : current->courses) {
+            appendCourse(out, course);
+        }
+        out.append("end\n");
+    }
+    else {
+        out.append("error: unknown command ").append(command).append(1, '\n');
+        return false;
+    }
+    return true;
 }
 
-// FIXME (1a): Implement the selection sort logic over course.title
-
 /**
- * Perform a selection sort on course title
- * Average performance: O(n^2))
- * Worst case performance O(n^2))
+ * ProjectTwo --batch [file]
  *
- * @param course address of the vector<course>
- *            instance to be sorted
+ * Reads commands, one per line, from file or stdin and writes the results
+ * to stdout in large blocks; no menu, no pauses. Blank lines and lines
+ * starting with # are skipped.
+ *
+ *   load <csv>                          catalog from the CSV, or its current snapshot
+ *   reload <csv>                        apply what changed in the CSV; "+", "~" or "-"
+ *                                       and the id for each course added, updated, removed
+ *   save <snapshot>
+ *   export <file> [text|csv|jsonl] [fields]  every course; fields as in --report, e.g. courseId,title
+ *   sort title|courseId [key|quick|selection]
+ *   find <courseId>                     one course line, or "not found <courseId>"
+ *   prereqs <courseId>                  all its prerequisites, then "end"
+ *   prefix <text>                       courses whose id starts with text, then "end"
+ *   fuzzy <text>                        up to 10 courses whose id or title is close to text,
+ *                                       as score, id|title and the course line, then "end"
+ *   search <words>                      up to 10 courses whose title has every word, best
+ *                                       first, as score and the course line, then "end"
+ *   search-any <words>                  the same for titles with any of the words
+ *   list                                every course, then "end"
+ *
+ * Course lines are tab separated: id, title, amount, prerequisites.
+ *
+ * @return 0 if every command succeeded, 1 otherwise
  */
-void selectionSort(vector<Course>& courses) {
-    //define min as int (index of the current minimum course)
-
-    // check size of courses vector
-    // set size_t platform-neutral result equal to course.size()
-
-    // pos is the position within courses that divides sorted/unsorted
-    // for size_t pos = 0 and less than size -1 
-        // set min = pos
-        // loop over remaining elements to the right of position
-            // if this element's title is less than minimum title
-                // this element becomes the minimum
-        // swap the current minimum with smaller one found
-            // swap is a built in vector method
-
-    //local variable declaration
-    int indexSmallest = 0;
-    Course tempSwap;
-
-    for (int i = 0; i < courses.size() - 1; i++) {
-
-        indexSmallest = i;
-
-        for (int j = i + 1; j < courses.size(); j++) {
-
-            if (courses[j].title < courses[indexSmallest].title) {
-                indexSmallest = j;
-            }
+int batchMain(int argc, char* argv[]) {
+    const size_t FLUSH_BYTES = 1 << 16;
+    std::ifstream file;
+    std::istream* in = &std::cin;
+
+    if (argc >= 3 && string(argv[2]) != "-") {
+        file.open(argv[2]);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << argv[2] << endl;
+            return 1;
         }
+        in = &file;
+    }
 
-        //swap the vector positions using a tempSwap variable of type course
-        tempSwap = courses[i];
-        courses[i] = courses[indexSmallest];
-        courses[indexSmallest] = tempSwap;
+    std::ios::sync_with_stdio(false);
+    string out;
+    bool ok = true;
 
+    for (string line; std::getline(*in, line);) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+        try {
+            ok &= runCommand(line.substr(start), out);
+        }
+        catch (Error& e) {
+            out.append("error: ").append(e.what()).append(1, '\n');
+            ok = false;
+        }
+        if (out.size() >= FLUSH_BYTES) {
+            std::cout.write(out.data(), out.size());
+            out.clear();
+        }
     }
+    std::cout.write(out.data(), out.size());
+    std::cout.flush();
+    return ok ? 0 : 1;
 }
 
+// set by --stats-json, read when the program exits
+bool statsAsJson = false;
+
 /**
- * Simple C function to convert a string to a double
- * after stripping out unwanted char
- *
- * credit: http://stackoverflow.com/a/24875936
- *
- * @param ch The character to strip out
+ * Print the collected metrics, registered with atexit by --stats
  */
-double strToDouble(string str, char ch) {
-    str.erase(remove(str.begin(), str.end(), ch), str.end());
-    return atof(str.c_str());
+void printStats() {
+    if (statsAsJson) {
+        std::cout << Metrics::json() << endl;
+    }
+    else {
+        Metrics::dump(std::cout);
+    }
 }
 
 /**
@@ -641,6 +6900,33 @@ double strToDouble(string str, char ch) {
  */
 int main(int argc, char* argv[]) {
 
+    // --stats / --stats-json anywhere on the command line: collect metrics, print them on exit
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--stats" || arg == "--stats-json") {
+            statsAsJson = arg == "--stats-json";
+            Metrics::enable(true);
+            std::atexit(printStats);
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+    argc = kept;
+
+    if (argc >= 2 && string(argv[1]) == "--bench") {
+        return benchMain(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        return batchMain(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "--report") {
+        return reportMain(argc, argv);
+    }
+    if (argc >= 2 && string(argv[1]) == "--sort") {
+        return sortMain(argc, argv);
+    }
+
     // process command line arguments
     string csvPath;
     switch (argc) {
@@ -663,8 +6949,9 @@ int main(int argc, char* argv[]) {
     int choice = 0;
     string anyKey = " ";
     bool goodInput;
-    Course course1;
+    const Course* found;
     string courseSearch;
+    std::shared_ptr<const Catalog> current; // the catalog generation being shown
 
     while (choice != 9) {
 
@@ -674,14 +6961,19 @@ int main(int argc, char* argv[]) {
         std::cout << "  3. Selection Sort All courses" << endl;
         std::cout << "  4. Quick Sort All courses" << endl;
         std::cout << "  5. Find Course" << endl;
+        std::cout << "  6. Find Courses by Prefix" << endl;
+        std::cout << "  7. Show Prerequisite Chain" << endl;
+        std::cout << "  8. Key Sort All courses" << endl;
         std::cout << "  9. Exit" << endl;
+        std::cout << " 10. Save Snapshot" << endl;
+        std::cout << " 11. Search Titles" << endl;
         std::cout << "Enter choice: ";
 
         try { //add a try catch to protect against bad input
 
             std::cin >> choice;
 
-            if ((choice > 0 && choice < 6) || (choice == 9)) {// limit the user menu inputs to good values
+            if (choice > 0 && choice <= 11) {// limit the user menu inputs to good values
                 goodInput = true;
             }
             else {//throw error for catch
@@ -695,29 +6987,51 @@ int main(int argc, char* argv[]) {
                 // Initialize a timer variable before loading courses
                 ticks = clock();
 
-                // Complete the method call to load the courses
-                courses = loadCourses(csvPath);
+                // Complete the method call to load the courses, from the snapshot when it is current;
+                // once loaded, only what changed in the file is read again
+                // a file that can't be read leaves the catalog as it was
+                try {
+                    if (catalog.current()->courses.empty()) {
+                        catalog.publish(openCatalog(csvPath));
+                    }
+                    else {
+                        ChangeSet changes;
+                        catalog.update([&csvPath, &changes](Catalog& next) {
+                            return reloadCourses(next, csvPath, changes);
+                        });
+                        std::cout << changes.added.size() << " added, " << changes.updated.size() << " updated, "
+                                  << changes.removed.size() << " removed" << endl;
+                    }
+                }
+                catch (Error& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+                catch (std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
 
-                std::cout << courses.size() << " courses read" << endl;
+                std::cout << catalog.current()->courses.size() << " courses read" << endl;
 
                 // Calculate elapsed time and display result
                 ticks = clock() - ticks; // current clock ticks minus starting clock ticks
                 std::cout << "time: " << ticks << " clock ticks" << endl;
                 std::cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
 
-                Sleep(GLOBAL_SLEEP_VALUE);
+                sleepFor(GLOBAL_SLEEP_VALUE);
 
                 break;
 
             case 2:
-                // Loop and display the courses read
-                for (int i = 0; i < courses.size(); ++i) {
-                    displayCourse(courses[i]);
+                // Display the courses read, formatted in large blocks rather than line by line
+                current = catalog.current();
+                {
+                    ReportWriter report(std::cout);
+                    report.writeAll(current->courses);
                 }
                 std::cout << "Press any key to continue...";
 
                 std::cin >> anyKey;
-                Sleep(GLOBAL_SLEEP_VALUE);
+                sleepFor(GLOBAL_SLEEP_VALUE);
 
                 break;
 
@@ -728,16 +7042,24 @@ int main(int argc, char* argv[]) {
                 //stop the clock with tick again and then outpout the time it tookto run
                 //sleep for some amount of time and then redraw the menu
 
-                ticks = clock();
+                // sort a copy and publish it, readers keep the current catalog meanwhile
+                catalog.update([&ticks](Catalog& next) {
+                    ticks = clock();
 
-                selectionSort(courses);
+                    selectionSort(next.courses);
 
-                // Calculate elapsed time and display result
-                ticks = clock() - ticks; // current clock ticks minus starting clock ticks
+                    // Calculate elapsed time
+                    ticks = clock() - ticks; // current clock ticks minus starting clock ticks
+
+                    // positions changed, the indexes have to follow
+                    next.reorder();
+                });
+
+                // display result
                 std::cout << "time: " << ticks << " clock ticks" << endl;
                 std::cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
 
-                Sleep(GLOBAL_SLEEP_VALUE);
+                sleepFor(GLOBAL_SLEEP_VALUE);
 
                 break;
 
@@ -748,16 +7070,24 @@ int main(int argc, char* argv[]) {
                 //stop the clock with tick again and then outpout the time it took to run
                 //sleep for some amount of time and then redraw the menu
 
-                ticks = clock();
+                // sort a copy and publish it, readers keep the current catalog meanwhile
+                catalog.update([&ticks](Catalog& next) {
+                    ticks = clock();
 
-                quickSort(courses, 0, courses.size() - 1);
+                    quickSort(next.courses, 0, next.courses.size() - 1, 0);
 
-                // Calculate elapsed time and display result
-                ticks = clock() - ticks; // current clock ticks minus starting clock ticks
+                    // Calculate elapsed time
+                    ticks = clock() - ticks; // current clock ticks minus starting clock ticks
+
+                    // positions changed, the indexes have to follow
+                    next.reorder();
+                });
+
+                // display result
                 std::cout << "time: " << ticks << " clock ticks" << endl;
                 std::cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
 
-                Sleep(GLOBAL_SLEEP_VALUE);
+                sleepFor(GLOBAL_SLEEP_VALUE);
 
                 break;
 
@@ -766,16 +7096,26 @@ int main(int argc, char* argv[]) {
                 std::cout << "Enter cource to search for:" << endl;
                 std::cin >> courseSearch;
                 ticks = clock();
-                //course1 = SearchCourse("CSCI100");
-                course1 = SearchCourse(courseSearch);
-                if (!course1.courseId._Equal(""))
+                //found = SearchCourse("CSCI100");
+                current = catalog.current();
+                found = SearchCourse(*current, courseSearch);
+                if (found != nullptr)
                 {
-                    std::cout << course1.courseId << ": " << course1.title << " | " << course1.amount << " | "
-                        << course1.prerequisites << endl;
+                    std::cout << found->courseId << ": " << found->title << " | " << found->amount << " | "
+                        << found->prerequisites << endl;
                 }
                 else
                 {
-                    std::cout << "Could not find course " << course1.title << endl;
+                    std::cout << "Could not find course " << courseSearch << endl;
+
+                    // typos and lower case still find the course
+                    vector<FuzzyMatch> close = current->fuzzyIndex().search(current->courses, courseSearch, 5);
+                    if (!close.empty()) {
+                        std::cout << "Did you mean:" << endl;
+                        for (const FuzzyMatch& match : close) {
+                            displayCourse(current->courses[match.course]);
+                        }
+                    }
                 }
 
                 std::cout << "Press any key to continue...";
@@ -799,18 +7139,145 @@ int main(int argc, char* argv[]) {
                 */
                 break;
 
+            case 6:
+
+                //prefix search over both course ids and titles, e.g. "CSCI3" or "Data"
+                std::cout << "Enter course id or title prefix:" << endl;
+                std::getline(std::cin >> std::ws, courseSearch);
+
+                current = catalog.current();
+                {
+                    // id matches first, then title matches not already shown
+                    PositionRange byId = current->byCourseId.prefix(current->courses, courseSearch);
+                    vector<uint32_t> shown(byId.begin(), byId.end());
+                    for (uint32_t pos : shown) {
+                        displayCourse(current->courses[pos]);
+                    }
+                    std::sort(shown.begin(), shown.end());
+                    for (uint32_t pos : current->byTitle.prefix(current->courses, courseSearch)) {
+                        if (!std::binary_search(shown.begin(), shown.end(), pos)) {
+                            displayCourse(current->courses[pos]);
+                        }
+                    }
+                }
+
+                std::cout << "Press any key to continue...";
+
+                std::cin >> anyKey;
+
+                break;
+
+            case 7:
+
+                //every course needed before this one, and every course that needs it
+                std::cout << "Enter course to trace:" << endl;
+                std::cin >> courseSearch;
+                current = catalog.current();
+                found = SearchCourse(*current, courseSearch);
+                if (found != nullptr)
+                {
+                    uint32_t pos = static_cast<uint32_t>(found - current->courses.data());
+
+                    std::cout << "Requires:" << endl;
+                    for (uint32_t p : current->prerequisitesOf(pos)) {
+                        displayCourse(current->courses[p]);
+                    }
+                    std::cout << "Required by:" << endl;
+                    for (uint32_t p : current->dependentsOf(pos)) {
+                        displayCourse(current->courses[p]);
+                    }
+                    if (current->onCycle(pos)) {
+                        std::cout << "Warning: " << found->courseId << " is part of a prerequisite cycle" << endl;
+                    }
+                }
+                else
+                {
+                    std::cout << "Could not find course " << courseSearch << endl;
+                }
+
+                std::cout << "Press any key to continue...";
+
+                std::cin >> anyKey;
+
+                break;
+
+            case 8:
+
+                //key sort switch, same timing as the other sorts
+                catalog.update([&ticks](Catalog& next) {
+                    ticks = clock();
+
+                    keySort(next.courses, &Course::title, 0);
+
+                    // Calculate elapsed time
+                    ticks = clock() - ticks; // current clock ticks minus starting clock ticks
+
+                    // positions changed, the indexes have to follow
+                    next.reorder();
+                });
+
+                // display result
+                std::cout << "time: " << ticks << " clock ticks" << endl;
+                std::cout << "time: " << ticks * 1.0 / CLOCKS_PER_SEC << " seconds" << endl;
+
+                sleepFor(GLOBAL_SLEEP_VALUE);
+
+                break;
+
             case 9:
                 //default case for the exit statement so we don't fail the try catch
 
                 break;
 
+            case 10:
+
+                //write the catalog as it is now, sort order included, for the next start
+                try {
+                    current = catalog.current();
+                    Snapshot::save(*current, snapshotPath(csvPath));
+                    std::cout << "Saved " << current->courses.size() << " courses to " << snapshotPath(csvPath) << endl;
+                }
+                catch (Error& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+
+                sleepFor(GLOBAL_SLEEP_VALUE);
+
+                break;
+
+            case 11:
+
+                //keyword search over the titles, e.g. "data structures"; titles with every
+                //word rank first, titles with only some of them are shown if there are none
+                std::cout << "Enter words to search titles for:" << endl;
+                std::getline(std::cin >> std::ws, courseSearch);
+                current = catalog.current();
+                {
+                    vector<TitleMatch> matches = current->titleIndex().search(courseSearch, TitleIndex::eALL_WORDS, 20);
+                    if (matches.empty()) {
+                        matches = current->titleIndex().search(courseSearch, TitleIndex::eANY_WORD, 20);
+                    }
+                    for (const TitleMatch& match : matches) {
+                        displayCourse(current->courses[match.course]);
+                    }
+                    if (matches.empty()) {
+                        std::cout << "No title matches " << courseSearch << endl;
+                    }
+                }
+
+                std::cout << "Press any key to continue...";
+
+                std::cin >> anyKey;
+
+                break;
+
             default:
                 throw 2;
             }
         }
         catch (int err) {
             std::cout << "\nPlease check your input." << endl;
-            Sleep(GLOBAL_SLEEP_VALUE);
+            sleepFor(GLOBAL_SLEEP_VALUE);
         }
 
         //need to clear the cin operator of extra input, e.g., 9 9, or any errors generated by bad input, e.g., 'a'
@@ -818,12 +7285,12 @@ int main(int argc, char* argv[]) {
         cin.ignore();
 
         //clear the consolse to redraw a fresh menu
-        system("cls");
+        clearScreen();
     }
 
     std::cout << "Good bye." << endl;
 
-    Sleep(GLOBAL_SLEEP_VALUE);
+    sleepFor(GLOBAL_SLEEP_VALUE);
 
     return 0;
 }
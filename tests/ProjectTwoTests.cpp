@@ -0,0 +1,192 @@
+//============================================================================
+// Name        : ProjectTwoTests.cpp
+// Description : Regression checks for ProjectTwo.cpp. Build it on its own
+//               (the program's main is renamed) and run it from a writable
+//               directory; it exits nonzero if any check fails.
+//============================================================================
+
+#define main projectTwoMain
+#include "../ProjectTwo.cpp"
+#undef main
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+void writeFile(const string& path, const string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+// a catalog of n courses whose titles all end in tag
+string catalogText(size_t n, const string& tag) {
+    string text = "courseId,title,prerequisites\n";
+    for (size_t i = 0; i < n; ++i) {
+        string id = "CSCI" + std::to_string(100 + i);
+        text += id + ",Course number " + std::to_string(i) + " " + tag + ",";
+        if (i > 0) {
+            text += "CSCI" + std::to_string(99 + i);
+        }
+        text += "\n";
+    }
+    return text;
+}
+
+// reloading over and over must not keep the text of earlier generations
+void testReloadPoolStaysBounded() {
+    const string path = "ProjectTwoTests_reload.csv";
+    const string first = catalogText(500, "first edition");
+    const string second = catalogText(500, "second and much longer edition of the title");
+
+    writeFile(path, second);
+    const size_t fullBytes = loadCourses(path).text->bytes();
+
+    writeFile(path, first);
+    CatalogHandle catalog;
+    catalog.publish(loadCourses(path));
+    std::weak_ptr<StringPool> firstPool = catalog.current()->text;
+
+    size_t largest = 0;
+    for (int round = 0; round < 50; ++round) {
+        writeFile(path, round % 2 == 0 ? second : first);
+        ChangeSet changes;
+        catalog.update([&path, &changes](Catalog& next) {
+            return reloadCourses(next, path, changes);
+        });
+        largest = std::max(largest, catalog.current()->text->bytes());
+    }
+
+    check(largest <= fullBytes, "reloaded pool is no larger than a full load's");
+    check(firstPool.expired(), "first generation's pool is freed after reloads");
+    std::remove(path.c_str());
+}
+
+// edits appended to <file>.log must show in every way of reading the file
+void testStreamingAppliesChangeLog() {
+    const string path = "ProjectTwoTests_log.csv";
+    writeFile(path, "courseId,title,prerequisites\nCSCI300,Old title,\nCSCI100,Intro,\nCSCI200,Gone,\n");
+    std::remove((path + ".log").c_str());
+    {
+        Parser parser(path);
+        parser.getRow(0).set("title", "New title");
+        parser.deleteRow(2);
+        parser.addRow(2, { "CSCI250", "Added", "CSCI100" });
+        parser.sync(eAPPEND_LOG);
+    }
+
+    string rows;
+    Parser::forEachRow(path, [&rows](const RecordView& row) {
+        rows += string(row[0]) + "|" + string(row[1]) + ";";
+    });
+    check(rows == "CSCI300|New title;CSCI100|Intro;CSCI250|Added;", "forEachRow replays the change log");
+
+    string records;
+    RecordParser<CourseColumns>().forEachRecord(path, [&records](const Course& course) {
+        records += string(course.courseId) + "|" + string(course.prerequisites) + ";";
+    });
+    check(records == "CSCI300|;CSCI100|;CSCI250|CSCI100;", "forEachRecord replays the change log");
+
+    std::ostringstream sorted;
+    ExternalSort(path, { "courseId" }).sort(sorted);
+    check(sorted.str().find("CSCI250,Added,CSCI100") != string::npos && sorted.str().find("Gone") == string::npos,
+          "ExternalSort replays the change log");
+
+    std::remove(path.c_str());
+    std::remove((path + ".log").c_str());
+}
+
+// a header that names the columns differently must not bind them by position
+void testHeaderWithoutFieldNamesIsRejected() {
+    const string path = "ProjectTwoTests_header.csv";
+    for (const char* header : { "Title,Id,Prereqs", "Name,Number,Requires" }) {
+        writeFile(path, string(header) + "\nIntro to Programming,CSCI100,\n");
+        string error;
+        try {
+            RecordParser<CourseColumns>().forEachRecord(path, [](const Course&) {});
+        }
+        catch (Error& e) {
+            error = e.what();
+        }
+        check(error.find("missing column courseId") != string::npos, (string("rejects header ") + header).c_str());
+    }
+    std::remove(path.c_str());
+}
+
+// a short query sharing no trigram with the course it is one typo away from
+void testFuzzyFindsShortIdWithTypo() {
+    const string path = "ProjectTwoTests_fuzzy.csv";
+    writeFile(path, "courseId,title,prerequisites\nABC,Alpha,\nXYZ,Omega,\n");
+    CatalogHandle catalog;
+    catalog.publish(loadCourses(path));
+    std::shared_ptr<const Catalog> current = catalog.current();
+
+    vector<FuzzyMatch> matches = current->fuzzyIndex().search(current->courses, "axc");
+    check(matches.size() == 1 && current->courses[matches[0].course].courseId == "ABC" && matches[0].distance == 1,
+          "fuzzy axc finds ABC");
+    std::remove(path.c_str());
+}
+
+// a snapshot whose closure row width does not fit its course count is not loaded
+void testSnapshotRejectsWrongClosureWidth() {
+    const string path = "ProjectTwoTests_snapshot.csv";
+    const string snapPath = path + ".snap";
+    writeFile(path, catalogText(100, "with a closure"));
+    Catalog loaded = loadCourses(path);
+    Snapshot::save(loaded, snapPath);
+
+    Catalog reloaded;
+    check(Snapshot::load(snapPath, reloaded) && reloaded.prerequisitesOf(99).size() == 99, "snapshot loads as saved");
+
+    // 100 courses take 2 words a row; 0x4000000000000002 words times 100 wraps around to 200
+    for (uint64_t words : { uint64_t(1), uint64_t(3), uint64_t(0x4000000000000002) }) {
+        std::fstream file(snapPath, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(SnapshotHeader, closureWords));
+        file.write(reinterpret_cast<const char*>(&words), sizeof(words));
+        file.close();
+        Catalog rejected;
+        check(!Snapshot::load(snapPath, rejected), ("rejects closureWords " + std::to_string(words)).c_str());
+    }
+    std::remove(path.c_str());
+    std::remove(snapPath.c_str());
+}
+
+// a --memory budget that overflows once scaled is refused, not wrapped around
+void testSortRejectsOverflowingMemory() {
+    const string path = "ProjectTwoTests_sort.csv";
+    const string outPath = "ProjectTwoTests_sorted.csv";
+    writeFile(path, catalogText(10, "to sort"));
+    std::remove(outPath.c_str());
+
+    for (const char* memory : { "99999999999G", "17179869184G" }) {
+        vector<string> args = { "ProjectTwo", "--sort", path, "--memory", memory, "--out", outPath };
+        vector<char*> argv;
+        for (string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        int status = sortMain(static_cast<int>(argv.size()), argv.data());
+        check(status != 0 && !std::ifstream(outPath).is_open(), (string("rejects --memory ") + memory).c_str());
+    }
+    std::remove(path.c_str());
+    std::remove(outPath.c_str());
+}
+
+} // namespace
+
+int main() {
+    testReloadPoolStaysBounded();
+    testStreamingAppliesChangeLog();
+    testHeaderWithoutFieldNamesIsRejected();
+    testFuzzyFindsShortIdWithTypo();
+    testSnapshotRejectsWrongClosureWidth();
+    testSortRejectsOverflowingMemory();
+
+    std::cout << (failures == 0 ? "all checks passed" : "some checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}